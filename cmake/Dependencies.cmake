@@ -13,6 +13,7 @@ list(APPEND Skywalker_LINKER_LIBS ${VOYAGER_LIBRARIES})
 find_package(Snappy)
 if(SNAPPY_FOUND)
   include_directories(SYSTEM ${SNAPPY_INCLUDE_DIRS})
+  add_definitions(-DSNAPPY)
   list(APPEND Skywalker_LINKER_LIBS ${SNAPPY_LIBRARIES})
 endif()
 
@@ -12,6 +12,7 @@ file(GLOB_RECURSE network_srcs ${CMAKE_CURRENT_SOURCE_DIR}/network/*.cc)
 file(GLOB_RECURSE paxos_srcs ${CMAKE_CURRENT_SOURCE_DIR}/paxos/*.cc)
 file(GLOB_RECURSE machine_srcs ${CMAKE_CURRENT_SOURCE_DIR}/machine/*.cc)
 file(GLOB_RECURSE log_srcs ${CMAKE_CURRENT_SOURCE_DIR}/log/*.cc)
+file(GLOB_RECURSE test_srcs ${CMAKE_CURRENT_SOURCE_DIR}/*/tests/*.cc)
 
 set(skywalker_srcs
   ${proto_srcs}
@@ -22,3 +23,4 @@ set(skywalker_srcs
   ${machine_srcs}
   ${log_srcs}
  )
+list(REMOVE_ITEM skywalker_srcs ${test_srcs})
@@ -32,6 +32,7 @@ int main(int argc, char** argv) {
   skywalker::Checkpoint checkpoint;
   skywalker::GroupOptions g_options;
   g_options.use_master = true;
+  g_options.stable_master = true;
   g_options.log_sync = true;
   g_options.sync_interval = 0;
   g_options.keep_log_count = 1000;
@@ -47,27 +47,37 @@ void JourneyServiceImpl::Propose(google::protobuf::RpcController* controller,
   response->set_result(PROPOSE_RESULT_FAIL);
   bool propose = false;
 
-  if (node_->IsMaster(group_id)) {
-    if (request->type() == PROPOSE_TYPE_GET) {
-      std::string s;
-      int res = machine_->Get(request->key(), &s);
-      if (res == 0) {
-        response->set_result(PROPOSE_RESULT_SUCCESS);
-        response->set_value(s);
-      } else if (res == 1) {
-        response->set_result(PROPOSE_RESULT_NOT_FOUND);
-      }
-    } else {
-      std::string value;
-      request->SerializeToString(&value);
-      propose = node_->Propose(
-          group_id, machine_->machine_id(), value, response,
-          [done, this](uint64_t, const skywalker::Status&, void* ctx) {
-            if (done) {
-              done->Run();
+  if (request->type() == PROPOSE_TYPE_GET) {
+    // Any node can serve the reads after it has caught up the read index.
+    std::string key(request->key());
+    propose = node_->ReadIndex(
+        group_id, response,
+        [done, key, this](uint64_t, const skywalker::Status& s, void* ctx) {
+          if (s.ok()) {
+            ResponseMessage* res = reinterpret_cast<ResponseMessage*>(ctx);
+            std::string value;
+            int ret = machine_->Get(key, &value);
+            if (ret == 0) {
+              res->set_result(PROPOSE_RESULT_SUCCESS);
+              res->set_value(value);
+            } else if (ret == 1) {
+              res->set_result(PROPOSE_RESULT_NOT_FOUND);
             }
-          });
-    }
+          }
+          if (done) {
+            done->Run();
+          }
+        });
+  } else if (node_->IsMaster(group_id)) {
+    std::string value;
+    request->SerializeToString(&value);
+    propose = node_->Propose(
+        group_id, machine_->machine_id(), value, response,
+        [done, this](uint64_t, const skywalker::Status&, void* ctx) {
+          if (done) {
+            done->Run();
+          }
+        });
   } else {
     skywalker::Member master;
     uint64_t version;
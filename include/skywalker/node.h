@@ -49,8 +49,28 @@ class Node {
                        const std::string& value, void* context,
                        ProposeCompleteCallback&& cb) = 0;
 
+  // The value is moved into the proposal without being copied.
+  virtual bool Propose(uint32_t group_id, uint32_t machine_id,
+                       std::string&& value, void* context,
+                       ProposeCompleteCallback&& cb) = 0;
+
+  // Get a read index of the group, which is linearizable to read the state
+  // machines of this node once they have executed the instances before it.
+  // The master gets it from its lease without any messages, the other nodes
+  // ask the master for it, and the callback waits for this node to catch up.
+  // The reads are only linearizable when all the values are proposed by the
+  // master, so it needs GroupOptions::stable_master.
+  // If the group uses stable master returns true, else returns false.
+  // Callback Status::OK() on success.
+  // Callback Status::NotMaster() if there is no master now.
+  // Callback Status::Timeout() if the master doesn't answer in a second.
+  virtual bool ReadIndex(uint32_t group_id, void* context,
+                         const ReadIndexCallback& cb) = 0;
+
   // Change the paxos members.
   // If propose success returns true, else returns false.
+  // Returns false if the new members don't fit GroupOptions::phase1_quorum
+  // and phase2_quorum.
   // The callback status like calling Node::Propose().
   virtual bool ChangeMember(uint32_t group_id,
                             const std::vector<std::pair<Member, bool>>& value,
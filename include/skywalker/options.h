@@ -25,6 +25,20 @@ typedef std::function<void(uint64_t instance_id, const Status& s,
                            void* context)>
     ProposeCompleteCallback;
 
+typedef std::function<void(uint64_t read_index, const Status& s,
+                           void* context)>
+    ReadIndexCallback;
+
+enum LogStorageType {
+  kLevelDBStorage = 0,
+  kSegmentStorage = 1,
+};
+
+enum CompressionType {
+  kNoCompression = 0,
+  kSnappyCompression = 1,
+};
+
 struct Member {
   uint64_t id;
   std::string host;
@@ -42,15 +56,71 @@ struct GroupOptions {
   // Default: 10 * 1000 * 1000 microseconds
   uint64_t master_lease_time;
 
+  // Only the master proposes while its lease lasts, it keeps the ballot
+  // of its last prepare for all the later instances and only runs the
+  // accept phase, even when an accept times out. The proposals on the
+  // other nodes are refused with Status::NotMaster. It needs use_master.
+  // The master answers ReadIndex without asking the others, which relies
+  // on the lease: the master counts its lease from the time it proposed,
+  // and the others count theirs from the later time they executed it. So
+  // it's safe if the clocks of the nodes drift apart less than 50
+  // milliseconds within master_lease_time. The reads are refused in the
+  // last 50 milliseconds of the lease, before it has been renewed.
+  // Default: false
+  bool stable_master;
+
   // Default: 5
   uint32_t sync_interval;
 
   // Default: 100000
   uint32_t keep_log_count;
 
+  // The max number of consecutive instances which the proposer can keep
+  // in the accept phase at the same time. The learned values are still
+  // executed in order. 1 means that the proposals are done one by one.
+  // Default: 1
+  uint32_t propose_window;
+
+  // The values proposed while the previous instances are in flight are
+  // packed into one batch, which is proposed on one instance. The values
+  // of a batch are executed one by one with the same instance_id.
+  // The max number of values in a batch, 1 means no batching.
+  // Default: 1
+  uint32_t batch_count;
+
+  // The max bytes of values in a batch.
+  // Default: 1024 * 1024
+  uint32_t batch_bytes;
+
+  // The number of promises which a prepare needs and the number of
+  // acceptances which an accept needs. Any prepare quorum must intersect
+  // any accept quorum, so phase1_quorum + phase2_quorum must be larger
+  // than the number of members, and the member changes breaking it are
+  // refused. With a stable master most proposals only run the accept
+  // phase, so a smaller phase2_quorum commits with fewer round trips at
+  // the cost of a larger phase1_quorum when the master changes. 0 means
+  // the majority. Node::Start fails if the sizes don't fit the membership
+  // above. If they don't fit a membership which is recovered or learned,
+  // both phases use the majority and an error is logged.
+  // Default: 0
+  uint32_t phase1_quorum;
+
+  // Default: 0
+  uint32_t phase2_quorum;
+
   // Default: ""
   std::string log_storage_path;
 
+  // The kSegmentStorage is an append-only engine made for the paxos log,
+  // the kLevelDBStorage is kept as the fallback. The type can't be changed
+  // once the log has been written.
+  // Default: kLevelDBStorage
+  LogStorageType log_storage_type;
+
+  // The size of a segment file of the kSegmentStorage.
+  // Default: 64 * 1024 * 1024
+  uint64_t segment_size;
+
   // Default: nullptr
   Checkpoint* checkpoint;
 
@@ -66,7 +136,7 @@ struct Options {
   //  ______________________________________________
   // | name                 |        size           |
   // |————————————————————————————————————————————--|
-  // | network thread       |          1            |
+  // | network thread       |          N            |
   // |                                              |
   // | master thread        |          1            |
   // |                                              |
@@ -74,6 +144,8 @@ struct Options {
   // |                                              |
   // | clean thread         |          1            |
   // |                                              |
+  // | group commit thread  |         0/1           |
+  // |                                              |
   // | io thread            |          N            |
   // |                                              |
   // | callback thread      |          N            |
@@ -81,8 +153,29 @@ struct Options {
   // | leveldb thread model |         0/1           |
   //  -----------------------------------------------
   // The skywalker's thread size is:
-  // 5 + io_thread_size + callback_thread_size
+  // 4 + network_thread_size + io_thread_size + callback_thread_size
+  // (+ 1 if group_commit)
 
+  // The peer connections are sharded across the network threads, and
+  // the received messages are parsed in them.
+  // Default: 1
+  uint32_t network_thread_size;
+
+  // The messages which are not smaller than compression_threshold bytes
+  // are compressed, if skywalker is built with snappy and the peer agrees
+  // to it when the connection is established. The older nodes ignore the
+  // handshake, so they always receive the messages uncompressed. A message
+  // is sent as it is if the compression doesn't save at least 12.5% of its
+  // bytes.
+  // Default: kSnappyCompression
+  CompressionType compression;
+
+  // Default: 1024
+  uint32_t compression_threshold;
+
+  // Every group has a loop of its own, and the io threads run the loops
+  // which are runnable. An idle io thread steals the loops queued to the
+  // others, so a busy group doesn't hold up the groups sharing its thread.
   // Default: io_thread_size = (groups.size() + 1) / 2
   // the io_thread_size must be (0, groups.size()]
   uint32_t io_thread_size;
@@ -91,6 +184,27 @@ struct Options {
   // the callback_thread_size must be (0, groups.size()]
   uint32_t callback_thread_size;
 
+  // The groups are recovered and replay their logs concurrently by
+  // recover_thread_size temporary threads when starting.
+  // Default: recover_thread_size = the number of cpus
+  // the recover_thread_size must be (0, groups.size()]
+  uint32_t recover_thread_size;
+
+  // The acceptor writes of all groups with log_sync are collected in
+  // group_commit_time and appended to one log shared by the groups with
+  // one sync before replying, the sync_interval of the groups is ignored.
+  // The dbs of the groups are synced when the shared log is trimmed.
+  // Default: false
+  bool group_commit;
+
+  // Default: 200 microseconds
+  uint64_t group_commit_time;
+
+  // The directory of the shared log of group commit. The writes left in it
+  // are replayed when starting, even if group_commit has been turned off.
+  // Default: "" (the log_storage_path of the group 0 + "/group_commit")
+  std::string group_commit_path;
+
   Member my;
 
   // the index of group options is group id.
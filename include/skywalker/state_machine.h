@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace skywalker {
 
@@ -22,6 +23,30 @@ class StateMachine {
   virtual bool Execute(uint32_t group_id, uint64_t instance_id,
                        const std::string& value, void* context = nullptr) = 0;
 
+  // Execute the values which have been learned together when catching up,
+  // the values[i] is chosen by the instance_ids[i], and they must be
+  // executed in order. Returns how many values have been executed
+  // successfully before the first failure.
+  virtual size_t ExecuteBatch(uint32_t group_id,
+                              const std::vector<uint64_t>& instance_ids,
+                              const std::vector<const std::string*>& values) {
+    size_t i = 0;
+    for (; i < values.size(); ++i) {
+      if (!Execute(group_id, instance_ids[i], *values[i])) {
+        break;
+      }
+    }
+    return i;
+  }
+
+  // Called after Checkpoint::LoadCheckpoint has loaded the checkpoint of
+  // the instance_id, the machine reloads its state from the checkpoint and
+  // returns true. If any machine returns false, the process exits after
+  // loading, and the machines recover from the checkpoint when it restarts.
+  virtual bool ReloadCheckpoint(uint32_t group_id, uint64_t instance_id) {
+    return false;
+  }
+
  private:
   uint32_t id_;
 };
@@ -37,6 +37,9 @@ class Status {
   static Status IOError(const Slice& msg, const Slice& msg2 = Slice()) {
     return Status(kIOError, msg, msg2);
   }
+  static Status NotMaster(const Slice& msg, const Slice& msg2 = Slice()) {
+    return Status(kNotMaster, msg, msg2);
+  }
 
   bool ok() const { return state_ == nullptr; }
   bool IsInvalidNode() const { return code() == kInvalidNode; }
@@ -44,6 +47,7 @@ class Status {
   bool IsMachineError() const { return code() == kMachineError; }
   bool IsTimeout() const { return code() == kTimeout; }
   bool IsIOError() const { return code() == kIOError; }
+  bool IsNotMaster() const { return code() == kNotMaster; }
 
   std::string ToString() const;
 
@@ -57,6 +61,7 @@ class Status {
     kMachineError = 3,
     kTimeout = 4,
     kIOError = 5,
+    kNotMaster = 6,
   };
 
   Code code() const {
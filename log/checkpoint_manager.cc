@@ -10,7 +10,10 @@
 namespace skywalker {
 
 CheckpointManager::CheckpointManager(Config* config)
-    : config_(config), sender_(config, this), receiver_(config, this) {}
+    : config_(config),
+      sender_(config, this),
+      receiver_(config, this),
+      send_loop_(nullptr) {}
 
 CheckpointManager::~CheckpointManager() {}
 
@@ -20,6 +23,11 @@ uint64_t CheckpointManager::GetCheckpointInstanceId() const {
     int res = config_->GetDB()->GetMaxInstanceId(&id);
     if (res == 0) {
       id = id - 1;
+      uint64_t chosen_id;
+      if (config_->GetDB()->GetMaxChosenInstanceId(&chosen_id) == 0 &&
+          chosen_id < id) {
+        id = chosen_id;
+      }
     }
   } else {
     id = config_->GetCheckpoint()->GetCheckpointInstanceId(
@@ -28,10 +36,22 @@ uint64_t CheckpointManager::GetCheckpointInstanceId() const {
   return id;
 }
 
+RunLoop* CheckpointManager::SendLoop() {
+  if (send_loop_ == nullptr) {
+    send_thread_.reset(new RunLoopThread());
+    send_loop_ = send_thread_->Loop();
+  }
+  return send_loop_;
+}
+
 bool CheckpointManager::SendCheckpoint(uint64_t node_id) {
   return sender_.SendCheckpoint(node_id);
 }
 
+bool CheckpointManager::HasLoadedCheckpoint(uint64_t* instance_id) {
+  return receiver_.HasLoaded(instance_id);
+}
+
 bool CheckpointManager::ReceiveCheckpoint(const CheckpointMessage& msg) {
   bool res = true;
   switch (msg.type()) {
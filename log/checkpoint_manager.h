@@ -5,8 +5,12 @@
 #ifndef SKYWALKER_LOG_CHECKPOINT_MANAGER_H_
 #define SKYWALKER_LOG_CHECKPOINT_MANAGER_H_
 
+#include <memory>
+
 #include "log/checkpoint_receiver.h"
 #include "log/checkpoint_sender.h"
+#include "util/runloop.h"
+#include "util/runloop_thread.h"
 
 namespace skywalker {
 
@@ -19,15 +23,26 @@ class CheckpointManager {
 
   uint64_t GetCheckpointInstanceId() const;
 
+  // The checkpoint of every group is sent in its own thread, which is
+  // started when it is first used.
+  RunLoop* SendLoop();
+
   bool SendCheckpoint(uint64_t node_id);
   bool ReceiveCheckpoint(const CheckpointMessage& message);
 
+  // Returns true once after a received checkpoint has been loaded.
+  bool HasLoadedCheckpoint(uint64_t* instance_id);
+
  private:
   Config* config_;
 
   CheckpointSender sender_;
   CheckpointReceiver receiver_;
 
+  // Destroyed before the sender_, which it may be using.
+  std::unique_ptr<RunLoopThread> send_thread_;
+  RunLoop* send_loop_;
+
   // No copying allowed
   CheckpointManager(const CheckpointManager&);
   void operator=(const CheckpointManager&);
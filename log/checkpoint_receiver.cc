@@ -18,15 +18,68 @@ namespace skywalker {
 
 CheckpointReceiver::CheckpointReceiver(Config* config,
                                        CheckpointManager* manager)
-    : config_(config), manager_(manager) {}
+    : config_(config),
+      manager_(manager),
+      sender_node_id_(0),
+      resume_node_id_(0),
+      instance_id_(0),
+      loaded_(false),
+      loaded_instance_id_(0) {}
 
-CheckpointReceiver::~CheckpointReceiver() {}
+CheckpointReceiver::~CheckpointReceiver() { CloseFiles(false); }
 
+// The first stream decides whether to resume the files, the others only
+// tell the sender where they have written.
 bool CheckpointReceiver::BeginToReceive(const CheckpointMessage& msg) {
-  sender_node_id_ = msg.node_id();
-  sequence_id_ = 0;
-  dirs_.clear();
+  bool res = true;
+  if (msg.stream_id() == 0) {
+    sender_node_id_ = msg.node_id();
+    CloseFiles(false);
+    if (msg.flag() && msg.node_id() == resume_node_id_ &&
+        msg.instance_id() == instance_id_) {
+      res = ResumeFiles();
+    } else {
+      dirs_.clear();
+      streams_.clear();
+      resume_node_id_ = msg.node_id();
+      instance_id_ = msg.instance_id();
+      res = ClearFiles();
+    }
+    for (auto& stream : streams_) {
+      stream.second.sequence_id = 0;
+    }
+  } else if (msg.node_id() != sender_node_id_ ||
+             msg.instance_id() != instance_id_) {
+    res = false;
+  }
+  if (res) {
+    streams_[msg.stream_id()].sequence_id = 0;
+  }
+  return ComfirmReceive(msg, res);
+}
 
+// Drop what was written after the last comfirmed offset, the sender
+// begins from the offset again.
+bool CheckpointReceiver::ResumeFiles() {
+  for (auto& it : streams_) {
+    Stream& stream = it.second;
+    if (stream.fname.empty()) {
+      continue;
+    }
+    std::string fname = dirs_[stream.machine_id] + "/" + stream.fname;
+    if (truncate(fname.c_str(), static_cast<off_t>(stream.offset)) != 0) {
+      LOG_ERROR("Group %u - truncate %s failed.", config_->GetGroupId(),
+                fname.c_str());
+      return false;
+    }
+    LOG_INFO("Group %u - resume the checkpoint from %s at %llu.",
+             config_->GetGroupId(), fname.c_str(),
+             (unsigned long long)stream.offset);
+  }
+  return true;
+}
+
+bool CheckpointReceiver::ClearFiles() {
   bool res = true;
   std::vector<std::string> dirs;
   std::vector<std::string> files;
@@ -49,13 +102,12 @@ bool CheckpointReceiver::BeginToReceive(const CheckpointMessage& msg) {
     }
     FileManager::Instance()->DeleteDir(d);
   }
-
-  return ComfirmReceive(msg, res);
+  return res;
 }
 
 bool CheckpointReceiver::ReceiveCheckpoint(const CheckpointMessage& msg) {
-  LOG_DEBUG("Group %u - sequence_id(%d==%d)", config_->GetGroupId(),
-            msg.sequence_id(), sequence_id_ + 1);
+  LOG_DEBUG("Group %u - stream_id=%d, sequence_id=%d", config_->GetGroupId(),
+            msg.stream_id(), msg.sequence_id());
   bool res = ReceiveFiles(msg);
   return ComfirmReceive(msg, res);
 }
@@ -65,13 +117,47 @@ bool CheckpointReceiver::ReceiveFiles(const CheckpointMessage& msg) {
     return false;
   }
 
-  if (msg.sequence_id() == sequence_id_) {
+  auto it = streams_.find(msg.stream_id());
+  if (it == streams_.end()) {
+    return false;
+  }
+  Stream& stream = it->second;
+
+  if (msg.sequence_id() == stream.sequence_id) {
     return true;
   }
 
-  if (msg.sequence_id() != sequence_id_ + 1) {
+  if (msg.sequence_id() != stream.sequence_id + 1) {
+    return false;
+  }
+
+  Status s;
+  if (stream.file == nullptr || stream.machine_id != msg.machine_id() ||
+      stream.fname != msg.file()) {
+    s = OpenFile(&stream, msg);
+  }
+  if (s.ok()) {
+    s = stream.file->Append(msg.data());
+    if (s.ok()) {
+      ++stream.sequence_id;
+      stream.offset = msg.offset();
+    }
+  }
+  if (!s.ok()) {
+    LOG_ERROR("Group %u - %s.", config_->GetGroupId(), s.ToString().c_str());
     return false;
   }
+  return true;
+}
+
+// The previous file of the stream has been received completely, so sync
+// it before writing the next one.
+Status CheckpointReceiver::OpenFile(Stream* stream,
+                                    const CheckpointMessage& msg) {
+  Status s = CloseFile(stream, true);
+  if (!s.ok()) {
+    return s;
+  }
 
   if (dirs_.find(msg.machine_id()) == dirs_.end()) {
     char dir[512];
@@ -80,36 +166,63 @@ bool CheckpointReceiver::ReceiveFiles(const CheckpointMessage& msg) {
     FileManager::Instance()->CreateDir(dir);
     bool exits = FileManager::Instance()->FileExists(dir);
     if (!exits) {
-      LOG_ERROR("Group %u - create checkpoint dir=%s failed.",
-                config_->GetGroupId(), dir);
-      return false;
+      return Status::IOError("create checkpoint dir failed", dir);
     }
     dirs_[msg.machine_id()] = std::string(dir);
   }
 
-  WritableFile* file;
   std::string fname = dirs_[msg.machine_id()] + "/" + msg.file();
-  Status s = FileManager::Instance()->NewAppendableFile(fname, &file);
+  s = FileManager::Instance()->NewAppendableFile(fname, &stream->file);
   if (s.ok()) {
-    s = file->Append(msg.data());
+    stream->machine_id = msg.machine_id();
+    stream->fname = msg.file();
+    stream->offset = 0;
+  }
+  return s;
+}
+
+Status CheckpointReceiver::CloseFile(Stream* stream, bool sync) {
+  Status s;
+  if (stream->file != nullptr) {
+    if (sync) {
+      s = stream->file->Sync();
+    }
     if (s.ok()) {
-      ++sequence_id_;
+      s = stream->file->Close();
     }
-    delete file;
+    delete stream->file;
+    stream->file = nullptr;
   }
-  if (!s.ok()) {
-    LOG_ERROR("Group %u - %s.", config_->GetGroupId(), s.ToString().c_str());
-    return false;
+  return s;
+}
+
+bool CheckpointReceiver::CloseFiles(bool sync) {
+  bool res = true;
+  for (auto& it : streams_) {
+    Status s = CloseFile(&it.second, sync);
+    if (!s.ok()) {
+      LOG_ERROR("Group %u - %s.", config_->GetGroupId(),
+                s.ToString().c_str());
+      res = false;
+    }
   }
-  return true;
+  return res;
 }
 
+// All the files of the other streams have been comfirmed before the
+// sender ends the first stream.
 bool CheckpointReceiver::EndToReceive(const CheckpointMessage& msg) {
   if (msg.node_id() != sender_node_id_) {
     return true;
   }
 
-  if (msg.sequence_id() != sequence_id_ + 1) {
+  auto it = streams_.find(msg.stream_id());
+  if (it == streams_.end() ||
+      msg.sequence_id() != it->second.sequence_id + 1) {
+    return false;
+  }
+
+  if (!CloseFiles(true)) {
     return false;
   }
 
@@ -143,13 +256,48 @@ bool CheckpointReceiver::EndToReceive(const CheckpointMessage& msg) {
 
   if (res) {
     LOG_INFO("Group %u - load checkpoint successful!", config_->GetGroupId());
-    LOG_WARN("Killing the process now...");
-    // FIXME
-    _exit(2);
+    if (!msg.membership().empty()) {
+      config_->GetMembershipMachine()->LoadString(msg.membership());
+    }
+    if (!msg.master_state().empty()) {
+      config_->GetMasterMachine()->LoadString(msg.master_state());
+    }
+    if (!ReloadMachines(msg.instance_id())) {
+      LOG_WARN("Killing the process now...");
+      _exit(2);
+    }
+    loaded_ = true;
+    loaded_instance_id_ = msg.instance_id();
+    Reset();
+    dirs_.clear();
+    streams_.clear();
+    resume_node_id_ = 0;
   }
   return res;
 }
 
+// The machines which can't reload their states in place recover them from
+// the checkpoint after restarting.
+bool CheckpointReceiver::ReloadMachines(uint64_t instance_id) {
+  for (auto machine : config_->GetStateMachines()) {
+    if (!machine->ReloadCheckpoint(config_->GetGroupId(), instance_id)) {
+      LOG_WARN("Group %u - machine(id=%u) can't reload the checkpoint.",
+               config_->GetGroupId(), machine->machine_id());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckpointReceiver::HasLoaded(uint64_t* instance_id) {
+  if (loaded_) {
+    loaded_ = false;
+    *instance_id = loaded_instance_id_;
+    return true;
+  }
+  return false;
+}
+
 bool CheckpointReceiver::ComfirmReceive(const CheckpointMessage& msg,
                                         bool res) {
   Content content;
@@ -158,8 +306,17 @@ bool CheckpointReceiver::ComfirmReceive(const CheckpointMessage& msg,
   CheckpointMessage* reply_msg = content.mutable_checkpoint_msg();
   reply_msg->set_type(CHECKPOINT_COMFIRM);
   reply_msg->set_node_id(config_->GetNodeId());
+  reply_msg->set_stream_id(msg.stream_id());
   reply_msg->set_sequence_id(msg.sequence_id());
   reply_msg->set_flag(res);
+  if (msg.type() == CHECKPOINT_BEGIN && res) {
+    const Stream& stream = streams_[msg.stream_id()];
+    if (!stream.fname.empty()) {
+      reply_msg->set_machine_id(stream.machine_id);
+      reply_msg->set_file(stream.fname);
+      reply_msg->set_offset(stream.offset);
+    }
+  }
   config_->GetMessager()->SendMessage(msg.node_id(), content);
   if (!res && msg.node_id() == sender_node_id_) {
     Reset();
@@ -168,10 +325,12 @@ bool CheckpointReceiver::ComfirmReceive(const CheckpointMessage& msg,
   return true;
 }
 
+// The written files are kept for resuming.
 void CheckpointReceiver::Reset() {
   sender_node_id_ = 0;
-  sequence_id_ = 0;
-  dirs_.clear();
+  for (auto& stream : streams_) {
+    stream.second.sequence_id = 0;
+  }
 }
 
 }  // namespace skywalker
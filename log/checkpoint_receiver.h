@@ -9,12 +9,17 @@
 #include <string>
 
 #include "proto/paxos.pb.h"
+#include "skywalker/status.h"
 
 namespace skywalker {
 
 class Config;
 class CheckpointManager;
+class WritableFile;
 
+// Receives the checkpoint files of every stream. The file being written by
+// a stream is kept open and synced once when the stream moves to the next
+// file or the checkpoint ends.
 class CheckpointReceiver {
  public:
   CheckpointReceiver(Config* config, CheckpointManager* manager);
@@ -26,8 +31,31 @@ class CheckpointReceiver {
 
   bool EndToReceive(const CheckpointMessage& msg);
 
+  // Returns true and stores the instance_id of the checkpoint in
+  // *instance_id once after a checkpoint has been loaded.
+  bool HasLoaded(uint64_t* instance_id);
+
  private:
+  struct Stream {
+    Stream() : sequence_id(0), file(nullptr), machine_id(0), offset(0) {}
+
+    int sequence_id;
+    WritableFile* file;
+
+    // Where the stream has written, so that the sender can resume from
+    // it if the same checkpoint is sent again.
+    int machine_id;
+    std::string fname;
+    uint64_t offset;
+  };
+
+  bool ResumeFiles();
+  bool ClearFiles();
   bool ReceiveFiles(const CheckpointMessage& msg);
+  Status OpenFile(Stream* stream, const CheckpointMessage& msg);
+  Status CloseFile(Stream* stream, bool sync);
+  bool CloseFiles(bool sync);
+  bool ReloadMachines(uint64_t instance_id);
   bool ComfirmReceive(const CheckpointMessage& msg, bool res);
   void Reset();
 
@@ -35,8 +63,14 @@ class CheckpointReceiver {
   CheckpointManager* manager_;
 
   uint64_t sender_node_id_;
-  int sequence_id_;
   std::map<int, std::string> dirs_;
+  std::map<int, Stream> streams_;
+
+  uint64_t resume_node_id_;
+  uint64_t instance_id_;
+
+  bool loaded_;
+  uint64_t loaded_instance_id_;
 
   // No copying allowed
   CheckpointReceiver(const CheckpointReceiver&);
@@ -45,4 +79,4 @@ class CheckpointReceiver {
 
 }  // namespace skywalker
 
-#endif  // SKYWALKER_LOG_CHECKPOINT_RECEIVER_H__
+#endif  // SKYWALKER_LOG_CHECKPOINT_RECEIVER_H_
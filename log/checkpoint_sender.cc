@@ -4,13 +4,16 @@
 
 #include "log/checkpoint_sender.h"
 
-#include <vector>
+#include <algorithm>
+#include <memory>
 
 #include "log/checkpoint_manager.h"
 #include "paxos/config.h"
 #include "skywalker/file.h"
 #include "skywalker/logging.h"
 #include "util/mutexlock.h"
+#include "util/thread.h"
+#include "util/timeops.h"
 
 namespace skywalker {
 
@@ -18,96 +21,244 @@ CheckpointSender::CheckpointSender(Config* config, CheckpointManager* manager)
     : config_(config),
       manager_(manager),
       receiver_node_id_(0),
-      sequence_id_(0),
       mutex_(),
       cond_(&mutex_),
-      ack_sequence_id_(0),
-      flag_(true) {}
+      flag_(true),
+      window_(16),
+      min_rtt_(0),
+      sample_time_(0),
+      sample_bytes_(0),
+      bandwidth_(0) {}
 
 CheckpointSender::~CheckpointSender() {}
 
 bool CheckpointSender::SendCheckpoint(uint64_t node_id) {
-  receiver_node_id_ = node_id;
-  sequence_id_ = 0;
-  ack_sequence_id_ = 0;
-  flag_ = true;
   bool res = config_->GetCheckpoint()->LockCheckpoint(config_->GetGroupId());
-  if (res) {
-    uint64_t instance_id = manager_->GetCheckpointInstanceId();
-    BeginToSend(instance_id);
-
-    res = SendCheckpointFiles(instance_id);
+  if (!res) {
+    LOG_WARN("Group %u - lock checkpoint failed.", config_->GetGroupId());
+    return res;
+  }
 
-    if (res) {
-      EndToSend(instance_id);
-    } else {
-      LOG_ERROR("Group %u - send checkpoint failed.", config_->GetGroupId());
+  uint64_t instance_id = manager_->GetCheckpointInstanceId();
+  std::vector<File> files;
+  res = GetCheckpointFiles(&files);
+  if (res) {
+    res = false;
+    bool resume = true;
+    for (int i = 0; !res && i < kMaxRetryCount; ++i) {
+      Reset(node_id, files);
+      if (!BeginToSend(instance_id, resume)) {
+        LOG_WARN("Group %u - begin to send checkpoint failed.",
+                 config_->GetGroupId());
+      } else if (!FindResumePosition()) {
+        // The receiver has another checkpoint, send it from scratch.
+        resume = false;
+      } else if (SendCheckpointFiles(instance_id)) {
+        EndToSend(instance_id);
+        res = true;
+      } else {
+        LOG_WARN("Group %u - send checkpoint broke, try to resume it.",
+                 config_->GetGroupId());
+      }
     }
-    config_->GetCheckpoint()->UnLockCheckpoint(config_->GetGroupId());
-  } else {
-    LOG_WARN("Group %u - lock checkpoint failed.", config_->GetGroupId());
   }
+  if (!res) {
+    LOG_ERROR("Group %u - send checkpoint failed.", config_->GetGroupId());
+  }
+  config_->GetCheckpoint()->UnLockCheckpoint(config_->GetGroupId());
   return res;
 }
 
-void CheckpointSender::BeginToSend(uint64_t instance_id) {
-  Content content;
-  content.set_type(CHECKPOINT_MESSAGE);
-  content.set_group_id(config_->GetGroupId());
-  CheckpointMessage* begin = content.mutable_checkpoint_msg();
-  begin->set_type(CHECKPOINT_BEGIN);
-  begin->set_node_id(config_->GetNodeId());
-  begin->set_instance_id(instance_id);
-  begin->set_sequence_id(sequence_id_++);
-  config_->GetMessager()->SendMessage(receiver_node_id_, content);
+// The files are dealt to the streams in turn, so the same files are always
+// divided in the same way and the streams can be resumed.
+void CheckpointSender::Reset(uint64_t node_id, const std::vector<File>& files) {
+  size_t count = files.size();
+  if (count > kMaxStreamCount) {
+    count = kMaxStreamCount;
+  } else if (count == 0) {
+    count = 1;
+  }
+  MutexLock lock(&mutex_);
+  receiver_node_id_ = node_id;
+  streams_.clear();
+  streams_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    Stream& stream = streams_[i];
+    stream.sender = this;
+    stream.stream_id = static_cast<int>(i);
+    stream.instance_id = 0;
+    stream.index = 0;
+    stream.offset = 0;
+    stream.res = false;
+    stream.sequence_id = 0;
+    stream.ack_sequence_id = 0;
+    stream.resume_machine_id = 0;
+    stream.resume_offset = 0;
+  }
+  for (size_t i = 0; i < files.size(); ++i) {
+    streams_[i % count].files.push_back(files[i]);
+  }
+  flag_ = true;
+  window_ = 16;
+  min_rtt_ = 0;
+  sample_time_ = 0;
+  sample_bytes_ = 0;
+  bandwidth_ = 0;
 }
 
-bool CheckpointSender::SendCheckpointFiles(uint64_t instance_id) {
-  bool res = true;
+bool CheckpointSender::GetCheckpointFiles(std::vector<File>* files) {
   std::string dir;
-  std::vector<std::string> files;
-
+  std::vector<std::string> temp;
   const std::vector<StateMachine*>& machines = config_->GetStateMachines();
   for (auto& machine : machines) {
-    files.clear();
-    res = config_->GetCheckpoint()->GetCheckpoint(
-        config_->GetGroupId(), machine->machine_id(), &dir, &files);
+    temp.clear();
+    bool res = config_->GetCheckpoint()->GetCheckpoint(
+        config_->GetGroupId(), machine->machine_id(), &dir, &temp);
     if (!res) {
       LOG_ERROR("Group %u - get checkpoint failed, the machine_id=%d.",
                 config_->GetGroupId(), machine->machine_id());
       return res;
     }
 
-    if (dir.empty() || files.empty()) {
+    if (dir.empty() || temp.empty()) {
       continue;
     }
     if (dir[dir.size() - 1] != '/') {
       dir += '/';
     }
-    for (auto& file : files) {
-      res = SendFile(instance_id, machine->machine_id(), dir, file);
-      if (!res) {
-        LOG_ERROR("Group %u - send file failed, the file=%s%s.",
-                  config_->GetGroupId(), dir.c_str(), file.c_str());
+    for (auto& file : temp) {
+      File f;
+      f.machine_id = machine->machine_id();
+      f.dir = dir;
+      f.file = file;
+      files->push_back(f);
+    }
+  }
+  return true;
+}
+
+// The receiver decides whether to resume when it receives the
+// CHECKPOINT_BEGIN of the first stream.
+bool CheckpointSender::BeginToSend(uint64_t instance_id, bool resume) {
+  for (auto& stream : streams_) {
+    Content content;
+    content.set_type(CHECKPOINT_MESSAGE);
+    content.set_group_id(config_->GetGroupId());
+    CheckpointMessage* begin = content.mutable_checkpoint_msg();
+    begin->set_type(CHECKPOINT_BEGIN);
+    begin->set_node_id(config_->GetNodeId());
+    begin->set_instance_id(instance_id);
+    begin->set_stream_id(stream.stream_id);
+    begin->set_flag(resume);
+    Send(&stream, &content, begin);
+  }
+  for (auto& stream : streams_) {
+    if (!CheckReceive(&stream, true)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckpointSender::FindResumePosition() {
+  for (auto& stream : streams_) {
+    if (stream.resume_file.empty()) {
+      continue;
+    }
+    bool found = false;
+    for (size_t i = 0; i < stream.files.size(); ++i) {
+      if (stream.files[i].machine_id == stream.resume_machine_id &&
+          stream.files[i].file == stream.resume_file) {
+        stream.index = i;
+        stream.offset = stream.resume_offset;
+        found = true;
+        LOG_INFO("Group %u - resume the checkpoint from %s at %llu.",
+                 config_->GetGroupId(), stream.resume_file.c_str(),
+                 (unsigned long long)stream.resume_offset);
         break;
       }
     }
+    if (!found) {
+      return false;
+    }
   }
-  return res;
+  return true;
+}
+
+void* CheckpointSender::StartStream(void* arg) {
+  Stream* stream = reinterpret_cast<Stream*>(arg);
+  stream->sender->SendStream(stream);
+  return nullptr;
+}
+
+// The first stream is sent in the current thread, and the others are sent
+// in their own threads.
+bool CheckpointSender::SendCheckpointFiles(uint64_t instance_id) {
+  for (auto& stream : streams_) {
+    stream.instance_id = instance_id;
+  }
+  {
+    std::vector<std::unique_ptr<Thread>> threads;
+    for (size_t i = 1; i < streams_.size(); ++i) {
+      threads.push_back(std::unique_ptr<Thread>(new Thread()));
+      threads.back()->Start(&CheckpointSender::StartStream, &streams_[i]);
+    }
+    SendStream(&streams_[0]);
+    for (auto& t : threads) {
+      t->Join();
+    }
+  }
+  for (auto& stream : streams_) {
+    if (!stream.res) {
+      return false;
+    }
+  }
+  return true;
 }
 
-bool CheckpointSender::SendFile(uint64_t instance_id, int machine_id,
-                                const std::string& dir,
-                                const std::string& file) {
-  std::string fname = dir + file;
-  SequentialFile* seq_file;
-  Status s = FileManager::Instance()->NewSequentialFile(fname, &seq_file);
+void CheckpointSender::SendStream(Stream* stream) {
+  stream->res = true;
+  for (; stream->index < stream->files.size(); ++stream->index) {
+    const File& f = stream->files[stream->index];
+    if (!SendFile(stream, f)) {
+      LOG_ERROR("Group %u - send file failed, the file=%s%s.",
+                config_->GetGroupId(), f.dir.c_str(), f.file.c_str());
+      stream->res = false;
+      break;
+    }
+    stream->offset = 0;
+  }
+  if (stream->res) {
+    stream->res = CheckReceive(stream, true);
+  }
+  if (!stream->res) {
+    // Stop the other streams as well.
+    MutexLock lock(&mutex_);
+    flag_ = false;
+    cond_.SignalAll();
+  }
+}
+
+bool CheckpointSender::SendFile(Stream* stream, const File& f) {
+  // The file is mapped, so the fragments are read from the page cache
+  // and copied only once into the sent message.
+  std::string fname = f.dir + f.file;
+  uint64_t offset = stream->offset;
+  uint64_t size = 0;
+  Status s = FileManager::Instance()->GetFileSize(fname, &size);
+  if (s.ok() && offset >= size) {
+    return true;
+  }
+  RandomAccessFile* file = nullptr;
+  if (s.ok()) {
+    s = FileManager::Instance()->NewRandomAccessFile(fname, &file);
+  }
   if (!s.ok()) {
     LOG_ERROR("Group %u - %s", config_->GetGroupId(), s.ToString().c_str());
     return false;
   }
   bool res = true;
-  size_t offset = 0;
+  std::unique_ptr<char[]> scratch(new char[kBufferSize]);
 
   Content content;
   content.set_type(CHECKPOINT_MESSAGE);
@@ -115,30 +266,28 @@ bool CheckpointSender::SendFile(uint64_t instance_id, int machine_id,
   CheckpointMessage* msg = content.mutable_checkpoint_msg();
   msg->set_type(CHECKPOINT_FILE);
   msg->set_node_id(config_->GetNodeId());
-  msg->set_instance_id(instance_id);
-  msg->set_machine_id(machine_id);
-  msg->set_file(file);
+  msg->set_instance_id(stream->instance_id);
+  msg->set_stream_id(stream->stream_id);
+  msg->set_machine_id(f.machine_id);
+  msg->set_file(f.file);
 
-  while (res) {
+  while (res && offset < size) {
+    size_t n = static_cast<size_t>(
+        std::min(size - offset, static_cast<uint64_t>(kBufferSize)));
     Slice fragmenet;
-    s = seq_file->Read(kBufferSize, &fragmenet, buffer_);
+    s = file->Read(offset, n, &fragmenet, scratch.get());
     if (!s.ok()) {
       res = false;
       LOG_ERROR("Group %u - %s", config_->GetGroupId(), s.ToString().c_str());
       break;
     }
-    if (fragmenet.empty()) {
-      break;
-    }
 
     offset += fragmenet.size();
-    msg->set_sequence_id(sequence_id_++);
     msg->set_offset(offset);
-    msg->set_data(fragmenet.data(), fragmenet.size());
-    config_->GetMessager()->SendMessage(receiver_node_id_, content);
-    res = CheckReceive();
+    Send(stream, &content, msg, fragmenet);
+    res = CheckReceive(stream, false);
   }
-  delete seq_file;
+  delete file;
 
   return res;
 }
@@ -151,32 +300,104 @@ void CheckpointSender::EndToSend(uint64_t instance_id) {
   end->set_type(CHECKPOINT_END);
   end->set_node_id(config_->GetNodeId());
   end->set_instance_id(instance_id);
-  end->set_sequence_id(sequence_id_);
+  end->set_stream_id(streams_[0].stream_id);
+  end->set_sequence_id(streams_[0].sequence_id);
+  end->set_membership(config_->GetMembershipMachine()->GetString());
+  end->set_master_state(config_->GetMasterMachine()->GetString());
   config_->GetMessager()->SendMessage(receiver_node_id_, content);
 }
 
+void CheckpointSender::Send(Stream* stream, Content* content,
+                            CheckpointMessage* msg, const Slice& data) {
+  {
+    MutexLock lock(&mutex_);
+    stream->send_times.push_back(NowMicros());
+  }
+  msg->set_sequence_id(stream->sequence_id++);
+  if (data.empty()) {
+    config_->GetMessager()->SendMessage(receiver_node_id_, *content);
+  } else {
+    config_->GetMessager()->SendMessage(receiver_node_id_, *content, data);
+  }
+}
+
 void CheckpointSender::OnComfirmReceive(const CheckpointMessage& msg) {
   MutexLock lock(&mutex_);
-  if (msg.node_id() == receiver_node_id_ &&
-      msg.sequence_id() == ack_sequence_id_) {
-    ++ack_sequence_id_;
-    flag_ = msg.flag();
-    cond_.Signal();
+  Stream* stream = nullptr;
+  if (msg.stream_id() >= 0 &&
+      static_cast<size_t>(msg.stream_id()) < streams_.size()) {
+    stream = &streams_[msg.stream_id()];
+  }
+  if (msg.node_id() == receiver_node_id_ && stream != nullptr &&
+      msg.sequence_id() == stream->ack_sequence_id) {
+    ++stream->ack_sequence_id;
+    if (!msg.flag()) {
+      flag_ = false;
+    } else if (msg.sequence_id() == 0) {
+      stream->resume_machine_id = msg.machine_id();
+      stream->resume_file = msg.file();
+      stream->resume_offset = msg.offset();
+    }
+    UpdateWindow(stream, NowMicros());
+    cond_.SignalAll();
   } else {
     LOG_WARN(
         "Group %u - receive a confirm message, "
-        "which node_id = %llu, sequence_id=%d, "
-        "but my sender_node_id_=%llu, ack_sequence_id_=%d.",
+        "which node_id = %llu, stream_id=%d, sequence_id=%d, "
+        "but my sender_node_id_=%llu.",
         config_->GetGroupId(), (unsigned long long)msg.node_id(),
-        msg.sequence_id(), (unsigned long long)receiver_node_id_,
-        ack_sequence_id_);
+        msg.stream_id(), msg.sequence_id(),
+        (unsigned long long)receiver_node_id_);
+  }
+}
+
+// The delivery rate is sampled about every round trip, since the
+// comfirmations may arrive in bursts.
+void CheckpointSender::UpdateWindow(Stream* stream, uint64_t now) {
+  if (!stream->send_times.empty()) {
+    uint64_t front = stream->send_times.front();
+    uint64_t rtt = now > front ? now - front : 1;
+    stream->send_times.pop_front();
+    if (min_rtt_ == 0 || rtt < min_rtt_) {
+      min_rtt_ = rtt;
+    }
+  }
+
+  sample_bytes_ += kBufferSize;
+  if (sample_time_ == 0) {
+    sample_time_ = now;
+    sample_bytes_ = 0;
+  } else if (now > sample_time_ && now - sample_time_ >= min_rtt_) {
+    double rate = static_cast<double>(sample_bytes_) /
+                  static_cast<double>(now - sample_time_);
+    bandwidth_ = (bandwidth_ == 0) ? rate : bandwidth_ * 0.75 + rate * 0.25;
+    sample_time_ = now;
+    sample_bytes_ = 0;
+
+    double window =
+        2 * bandwidth_ * static_cast<double>(min_rtt_) / kBufferSize;
+    if (window < kMinWindow) {
+      window_ = kMinWindow;
+    } else if (window > kMaxWindow) {
+      window_ = kMaxWindow;
+    } else {
+      window_ = static_cast<int>(window);
+    }
   }
 }
 
-bool CheckpointSender::CheckReceive() {
+// The window is shared by all the streams.
+bool CheckpointSender::CheckReceive(Stream* stream, bool all) {
   bool res = true;
   MutexLock lock(&mutex_);
-  while (flag_ && (sequence_id_ > ack_sequence_id_ + 16)) {
+  while (flag_) {
+    int window = 0;
+    if (!all) {
+      window = std::max(window_ / static_cast<int>(streams_.size()), 1);
+    }
+    if (stream->sequence_id <= stream->ack_sequence_id + window) {
+      break;
+    }
     res = cond_.Wait(10 * 1000 * 1000);
     if (!res) {
       LOG_ERROR("Group %u - receive comfirm message timeout!",
@@ -5,9 +5,12 @@
 #ifndef SKYWALKER_LOG_CHECKPOINT_SENDER_H_
 #define SKYWALKER_LOG_CHECKPOINT_SENDER_H_
 
+#include <deque>
 #include <string>
+#include <vector>
 
 #include "proto/paxos.pb.h"
+#include "skywalker/slice.h"
 #include "util/mutex.h"
 
 namespace skywalker {
@@ -15,6 +18,12 @@ namespace skywalker {
 class Config;
 class CheckpointManager;
 
+// Sends the checkpoint files to a node. The files are divided into several
+// streams, which are sent concurrently and have their own sequence spaces.
+// The messages which haven't been comfirmed are limited by a window, which
+// is about twice of the measured bandwidth multiplied by the min round trip
+// time. If the sending breaks, it begins again and every stream resumes
+// from where the receiver has written.
 class CheckpointSender {
  public:
   CheckpointSender(Config* config, CheckpointManager* manager);
@@ -25,28 +34,73 @@ class CheckpointSender {
 
  private:
   static const int kBufferSize = 65535;
-
-  void BeginToSend(uint64_t instance_id);
+  static const int kMinWindow = 4;
+  static const int kMaxWindow = 512;
+  static const int kMaxRetryCount = 3;
+  static const size_t kMaxStreamCount = 4;
+
+  struct File {
+    int machine_id;
+    std::string dir;
+    std::string file;
+  };
+
+  struct Stream {
+    CheckpointSender* sender;
+    int stream_id;
+    uint64_t instance_id;
+    std::vector<File> files;
+    size_t index;
+    uint64_t offset;
+    bool res;
+
+    // Only used by the thread which sends the stream.
+    int sequence_id;
+
+    // Guarded by the mutex_.
+    int ack_sequence_id;
+    std::deque<uint64_t> send_times;
+
+    // Where the receiver has written, which is told by the comfirmation
+    // of CHECKPOINT_BEGIN.
+    int resume_machine_id;
+    std::string resume_file;
+    uint64_t resume_offset;
+  };
+
+  static void* StartStream(void* arg);
+
+  void Reset(uint64_t node_id, const std::vector<File>& files);
+  bool GetCheckpointFiles(std::vector<File>* files);
+  bool BeginToSend(uint64_t instance_id, bool resume);
+  bool FindResumePosition();
   bool SendCheckpointFiles(uint64_t instance_id);
-  bool SendFile(uint64_t instance_id, int machine_id, const std::string& dir,
-                const std::string& file);
+  void SendStream(Stream* stream);
+  bool SendFile(Stream* stream, const File& f);
   void EndToSend(uint64_t instance_id);
+  void Send(Stream* stream, Content* content, CheckpointMessage* msg,
+            const Slice& data = Slice());
 
-  bool CheckReceive();
-
-  char buffer_[kBufferSize];
+  bool CheckReceive(Stream* stream, bool all);
+  void UpdateWindow(Stream* stream, uint64_t now);
 
   Config* config_;
   CheckpointManager* manager_;
 
   uint64_t receiver_node_id_;
-  int sequence_id_;
+  std::vector<Stream> streams_;
 
   Mutex mutex_;
   Condition cond_;
-  int ack_sequence_id_;
   bool flag_;
 
+  // Measured by the comfirmations of all the streams.
+  int window_;
+  uint64_t min_rtt_;
+  uint64_t sample_time_;
+  uint64_t sample_bytes_;
+  double bandwidth_;
+
   // No copying allowed
   CheckpointSender(const CheckpointSender&);
   void operator=(const CheckpointSender&);
@@ -45,7 +45,7 @@ void LogCleaner::GCLoop() {
 
   WriteOptions options;
   options.sync = false;
-  int res = config_->GetDB()->Write(options, &batch);
+  int res = config_->GetDB()->WriteChosen(options, &batch, min_chosen_id);
   if (res == 0) {
     manager_->SetMinChosenInstanceId(min_chosen_id);
   }
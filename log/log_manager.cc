@@ -4,6 +4,7 @@
 
 #include "log/log_manager.h"
 
+#include <memory>
 #include <string>
 
 #include "paxos/config.h"
@@ -38,18 +39,23 @@ bool LogManager::Recover(uint64_t* instance_id) {
 }
 
 bool LogManager::ReplayLog(uint64_t from, uint64_t to) {
-  for (uint64_t instance_id = from; instance_id < to; ++instance_id) {
-    std::string s;
-    int res = config_->GetDB()->Get(instance_id, &s);
-    if (res != 0) {
-      LOG_ERROR("Group %u - replay log failed, the instance_id=%llu.",
-                config_->GetGroupId(), (unsigned long long)instance_id);
-      return false;
+  std::unique_ptr<LogIterator> iter(config_->GetDB()->NewIterator());
+  uint64_t instance_id = from;
+  for (iter->Seek(from); instance_id < to && iter->Valid(); iter->Next()) {
+    if (iter->key() != instance_id) {
+      break;
     }
+    Slice s(iter->value());
     PaxosInstance temp;
-    temp.ParseFromString(s);
+    temp.ParseFromArray(s.data(), static_cast<int>(s.size()));
     const PaxosValue& value = temp.accepted_value();
     config_->GetMachineManager()->Execute(instance_id, value, nullptr);
+    ++instance_id;
+  }
+  if (instance_id < to) {
+    LOG_ERROR("Group %u - replay log failed, the instance_id=%llu.",
+              config_->GetGroupId(), (unsigned long long)instance_id);
+    return false;
   }
   LOG_INFO("Group %u - replay log successful, from %llu to %llu.",
            config_->GetGroupId(), (unsigned long long)from,
@@ -72,6 +78,9 @@ void LogManager::SetMinChosenInstanceId(uint64_t id) {
 
 uint64_t LogManager::GetMaxChosenInstanceId() const { return max_chosen_id_; }
 
+// When proposing with a window, the log may have some instances which are
+// accepted but not chosen, so the max chosen one is recorded for recovering.
+// It's written with the records of the learner and the acceptor.
 void LogManager::SetMaxChosenInstanceId(uint64_t id) { max_chosen_id_ = id; }
 
 }  // namespace skywalker
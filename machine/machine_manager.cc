@@ -12,7 +12,8 @@
 
 namespace skywalker {
 
-MachineManager::MachineManager(Config* config) : config_(config) {}
+MachineManager::MachineManager(Config* config)
+    : config_(config), partial_instance_id_(0), partial_count_(0) {}
 
 void MachineManager::AddMachine(StateMachine* machine) {
   assert(machine->machine_id() != -1);
@@ -25,6 +26,100 @@ void MachineManager::RemoveMachine(StateMachine* machine) {
 
 bool MachineManager::Execute(uint64_t instance_id, const PaxosValue& value,
                              void* context) {
+  if (value.noop()) {
+    return true;
+  }
+  if (!value.batch()) {
+    return ExecuteOne(instance_id, value, context);
+  }
+
+  BatchContext* batch = reinterpret_cast<BatchContext*>(context);
+  int i = 0;
+  if (partial_count_ > 0 && partial_instance_id_ == instance_id) {
+    i = partial_count_;
+  }
+  for (; i < value.values_size(); ++i) {
+    bool b = ExecuteOne(instance_id, value.values(i),
+                        batch ? batch->contexts[i] : nullptr);
+    if (batch) {
+      batch->results[i] = b;
+    }
+    if (!b) {
+      partial_instance_id_ = instance_id;
+      partial_count_ = i;
+      return false;
+    }
+  }
+  partial_count_ = 0;
+  return true;
+}
+
+size_t MachineManager::ExecuteBatch(
+    uint64_t instance_id, const std::vector<const PaxosValue*>& values) {
+  // Flatten the batched values, the positions[i] is the index of the
+  // instance which the entry i belongs to, and the offsets[i] is the index
+  // of the entry in the instance. The entries of the first instance which
+  // have been executed are skipped.
+  std::vector<const PaxosValue*> entries;
+  std::vector<size_t> positions;
+  std::vector<int> offsets;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (values[i]->noop()) {
+      continue;
+    }
+    if (!values[i]->batch()) {
+      entries.push_back(values[i]);
+      positions.push_back(i);
+      offsets.push_back(0);
+    } else {
+      int k = 0;
+      if (i == 0 && partial_count_ > 0 &&
+          partial_instance_id_ == instance_id) {
+        k = partial_count_;
+      }
+      for (; k < values[i]->values_size(); ++k) {
+        entries.push_back(&values[i]->values(k));
+        positions.push_back(i);
+        offsets.push_back(k);
+      }
+    }
+  }
+
+  std::vector<uint64_t> instance_ids;
+  std::vector<const std::string*> data;
+  size_t i = 0;
+  while (i < entries.size()) {
+    uint32_t machine_id = entries[i]->machine_id();
+    size_t j = i;
+    instance_ids.clear();
+    data.clear();
+    while (j < entries.size() && entries[j]->machine_id() == machine_id) {
+      instance_ids.push_back(instance_id + positions[j]);
+      data.push_back(&entries[j]->user_data());
+      ++j;
+    }
+    auto it = machines_.find(machine_id);
+    if (it != machines_.end()) {
+      assert(it->second != nullptr);
+      size_t n =
+          it->second->ExecuteBatch(config_->GetGroupId(), instance_ids, data);
+      if (n < data.size()) {
+        partial_instance_id_ = instance_id + positions[i + n];
+        partial_count_ = offsets[i + n];
+        return positions[i + n];
+      }
+    } else {
+      LOG_WARN("Group %u - machine(id=%u) is not existed.",
+               config_->GetGroupId(), machine_id);
+    }
+    i = j;
+  }
+  partial_count_ = 0;
+  return values.size();
+}
+
+bool MachineManager::ExecuteOne(uint64_t instance_id, const PaxosValue& value,
+                                void* context) {
   auto it = machines_.find(value.machine_id());
   if (it != machines_.end()) {
     assert(it->second != nullptr);
@@ -6,6 +6,7 @@
 #define SKYWALKER_PAXOS_MACHINE_MANAGER_H_
 
 #include <map>
+#include <vector>
 
 #include "proto/paxos.pb.h"
 #include "skywalker/state_machine.h"
@@ -14,6 +15,13 @@ namespace skywalker {
 
 class Config;
 
+// The context of a batched value, the contexts[i] and the results[i]
+// are for the value.values(i).
+struct BatchContext {
+  std::vector<void*> contexts;
+  std::vector<bool> results;
+};
+
 class MachineManager {
  public:
   explicit MachineManager(Config* config);
@@ -21,12 +29,31 @@ class MachineManager {
   void AddMachine(StateMachine* machine);
   void RemoveMachine(StateMachine* machine);
 
+  // If the value is a batch, the context must be nullptr or a BatchContext.
+  // A no-op value is skipped. The entries of a batch stop at the first
+  // failure, and the next execution of the instance resumes from it.
   bool Execute(uint64_t instance_id, const PaxosValue& value, void* context);
 
+  // Execute the values of the instances from instance_id in order, the
+  // values for the same machine are executed by one StateMachine::
+  // ExecuteBatch(). Returns how many instances have been executed
+  // successfully before the first failure. Like Execute(), the failed
+  // instance resumes from its failed entry next time.
+  size_t ExecuteBatch(uint64_t instance_id,
+                      const std::vector<const PaxosValue*>& values);
+
  private:
+  bool ExecuteOne(uint64_t instance_id, const PaxosValue& value,
+                  void* context);
+
   Config* config_;
   std::map<uint32_t, StateMachine*> machines_;
 
+  // How many entries of the batched instance have been executed before
+  // the failed one.
+  uint64_t partial_instance_id_;
+  int partial_count_;
+
   // No copying allowed
   MachineManager(const MachineManager&);
   void operator=(const MachineManager&);
@@ -67,6 +67,7 @@ bool MasterMachine::Execute(uint32_t group_id, uint64_t instance_id,
 }
 
 std::string MasterMachine::GetString() const {
+  MutexLock lock(&mutex_);
   std::string s;
   if (state_.lease_time() > NowMicros()) {
     state_.SerializeToString(&s);
@@ -82,6 +83,20 @@ void MasterMachine::SetString(const std::string& s) {
   }
 }
 
+// The lease time is written as the rest of the lease, like Execute writes
+// the whole lease.
+void MasterMachine::LoadString(const std::string& s) {
+  SetString(s);
+  MasterState state(GetMasterState());
+  uint64_t now = NowMicros();
+  state.set_lease_time(state.lease_time() > now ? state.lease_time() - now
+                                                : 0);
+  if (config_->GetDB()->SetMasterState(state) != 0) {
+    LOG_ERROR("Group %u - update master state failed.",
+              config_->GetGroupId());
+  }
+}
+
 void MasterMachine::SetMasterState(const MasterState& state) {
   MutexLock lock(&mutex_);
   state_ = state;
@@ -102,10 +117,10 @@ bool MasterMachine::GetMaster(uint64_t* node_id, uint64_t* version) const {
   return false;
 }
 
-bool MasterMachine::IsMaster() const {
+bool MasterMachine::IsMaster(uint64_t margin) const {
   MutexLock lock(&mutex_);
   if (state_.node_id() == config_->GetNodeId() &&
-      state_.lease_time() > NowMicros()) {
+      state_.lease_time() > NowMicros() + margin) {
     return true;
   }
   return false;
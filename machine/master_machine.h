@@ -27,10 +27,14 @@ class MasterMachine : public StateMachine {
   MasterState GetMasterState() const;
 
   bool GetMaster(uint64_t* node_id, uint64_t* version) const;
-  bool IsMaster() const;
+  // The lease of this node lasts at least margin microseconds more.
+  bool IsMaster(uint64_t margin = 0) const;
 
   std::string GetString() const;
   void SetString(const std::string& s);
+  // The master state received with a checkpoint, which is written like an
+  // executed one, so it's recovered after restarting.
+  void LoadString(const std::string& s);
 
   virtual bool Execute(uint32_t group_id, uint64_t instance_id,
                        const std::string& value, void* context);
@@ -13,6 +13,8 @@ namespace skywalker {
 MembershipMachine::MembershipMachine(Config* config,
                                      const GroupOptions& options)
     : config_(config),
+      phase1_quorum_(options.phase1_quorum),
+      phase2_quorum_(options.phase2_quorum),
       has_sync_membership_(false),
       membership_(new Membership()) {
   set_machine_id(0);
@@ -24,6 +26,7 @@ MembershipMachine::MembershipMachine(Config* config,
     member.set_context(i.context);
     (*(membership_->mutable_members()))[member.id()] = member;
   }
+  PublishView();
 }
 
 void MembershipMachine::Recover() {
@@ -32,6 +35,7 @@ void MembershipMachine::Recover() {
   if (ret == 0) {
     has_sync_membership_ = true;
     membership_.reset(temp);
+    PublishView();
   } else {
     delete temp;
   }
@@ -67,6 +71,7 @@ bool MembershipMachine::Execute(uint32_t group_id, uint64_t instance_id,
       }
     }
     membership_->set_version(instance_id);
+    PublishView();
 
     int ret = config_->GetDB()->SetMembership(*membership_);
     if (ret == 0) {
@@ -98,16 +103,44 @@ void MembershipMachine::SetString(const std::string& s) {
   MutexLock lock(&mutex_);
   if (temp->version() > membership_->version()) {
     membership_.reset(temp);
+    PublishView();
   } else {
     delete temp;
   }
 }
 
+void MembershipMachine::LoadString(const std::string& s) {
+  SetString(s);
+  MutexLock lock(&mutex_);
+  has_sync_membership_ = true;
+  if (config_->GetDB()->SetMembership(*membership_) != 0) {
+    LOG_ERROR("Group %u - update membership failed.", config_->GetGroupId());
+  }
+}
+
 std::shared_ptr<Membership> MembershipMachine::GetMembership() const {
   MutexLock lock(&mutex_);
   return membership_;
 }
 
+// The view is replaced atomically, so the readers don't take the mutex_.
+void MembershipMachine::PublishView() {
+  std::shared_ptr<const MembershipView> view(
+      new MembershipView(*membership_, phase1_quorum_, phase2_quorum_));
+  if (phase1_quorum_ != 0 || phase2_quorum_ != 0) {
+    if (!MembershipView::IsValid(view->size(), phase1_quorum_,
+                                 phase2_quorum_)) {
+      LOG_ERROR("Group %u - the quorums don't fit %llu members, use majority.",
+               config_->GetGroupId(), (unsigned long long)view->size());
+    }
+  }
+  std::atomic_store(&view_, view);
+}
+
+std::shared_ptr<const MembershipView> MembershipMachine::GetView() const {
+  return std::atomic_load(&view_);
+}
+
 bool MembershipMachine::HasSyncMembership() const {
   return has_sync_membership_;
 }
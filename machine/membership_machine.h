@@ -5,9 +5,11 @@
 #ifndef SKYWALKER_MACHINE_MEMBERSHIP_MACHINE_H_
 #define SKYWALKER_MACHINE_MEMBERSHIP_MACHINE_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "machine/membership_view.h"
 #include "proto/paxos.pb.h"
 #include "skywalker/options.h"
 #include "skywalker/state_machine.h"
@@ -26,20 +28,30 @@ class MembershipMachine : public StateMachine {
   void SetNewMembershipCallback(const NewMembershipCallback& cb) { cb_ = cb; }
 
   std::shared_ptr<Membership> GetMembership() const;
+  // Doesn't lock, the view should be taken once and used for a while.
+  std::shared_ptr<const MembershipView> GetView() const;
   bool HasSyncMembership() const;
 
   std::string GetString() const;
   void SetString(const std::string& s);
+  // The membership received with a checkpoint, which is written like an
+  // executed one, so it's recovered after restarting.
+  void LoadString(const std::string& s);
 
   virtual bool Execute(uint32_t group_id, uint64_t instance_id,
                        const std::string& value, void* /* context */);
 
  private:
+  void PublishView();
+
   Config* config_;
+  const uint32_t phase1_quorum_;
+  const uint32_t phase2_quorum_;
   bool has_sync_membership_;
 
   mutable Mutex mutex_;
   std::shared_ptr<Membership> membership_;
+  std::shared_ptr<const MembershipView> view_;
 
   NewMembershipCallback cb_;
 
@@ -0,0 +1,55 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "machine/membership_view.h"
+
+#include <algorithm>
+
+namespace skywalker {
+
+namespace {
+
+size_t QuorumSize(size_t node_size, uint32_t size) {
+  return size != 0 ? size : node_size / 2 + 1;
+}
+
+}  // namespace
+
+MembershipView::MembershipView(const Membership& membership, uint32_t phase1,
+                               uint32_t phase2)
+    : version_(membership.version()) {
+  nodes_.reserve(membership.members().size());
+  for (auto& i : membership.members()) {
+    nodes_.push_back(i.first);
+  }
+  std::sort(nodes_.begin(), nodes_.end());
+  members_.reserve(nodes_.size());
+  for (auto id : nodes_) {
+    members_.push_back(membership.members().at(id));
+  }
+
+  if (!IsValid(nodes_.size(), phase1, phase2)) {
+    phase1 = 0;
+    phase2 = 0;
+  }
+  phase1_ = QuorumSize(nodes_.size(), phase1);
+  phase2_ = QuorumSize(nodes_.size(), phase2);
+}
+
+bool MembershipView::IsValid(size_t node_size, uint32_t phase1,
+                             uint32_t phase2) {
+  size_t q1 = QuorumSize(node_size, phase1);
+  size_t q2 = QuorumSize(node_size, phase2);
+  return q1 <= node_size && q2 <= node_size && q1 + q2 > node_size;
+}
+
+int MembershipView::IndexOf(uint64_t node_id) const {
+  auto it = std::lower_bound(nodes_.begin(), nodes_.end(), node_id);
+  if (it == nodes_.end() || *it != node_id) {
+    return -1;
+  }
+  return static_cast<int>(it - nodes_.begin());
+}
+
+}  // namespace skywalker
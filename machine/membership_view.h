@@ -0,0 +1,60 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_MACHINE_MEMBERSHIP_VIEW_H_
+#define SKYWALKER_MACHINE_MEMBERSHIP_VIEW_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "proto/paxos.pb.h"
+
+namespace skywalker {
+
+// A compact and immutable copy of a membership. The members are kept in
+// flat arrays sorted by the node id, so a member is found by its dense
+// index [0, size()), and the votes of a round can be kept in a bitset.
+// Every member has one vote, a prepare passes with Phase1Size() votes and
+// an accept passes with Phase2Size() votes. A new view is published when
+// the membership changes, and the readers hold the view they have taken
+// for a whole round.
+class MembershipView {
+ public:
+  // The phase sizes are the GroupOptions::phase1_quorum and phase2_quorum,
+  // they are replaced by the majority if they aren't valid for the members.
+  MembershipView(const Membership& membership, uint32_t phase1,
+                 uint32_t phase2);
+
+  // Whether the phase sizes are valid for node_size members, that is every
+  // phase 1 quorum intersects every phase 2 quorum. 0 means the majority.
+  static bool IsValid(size_t node_size, uint32_t phase1, uint32_t phase2);
+
+  uint64_t version() const { return version_; }
+  size_t size() const { return nodes_.size(); }
+
+  uint64_t node_id(size_t index) const { return nodes_[index]; }
+  const MemberMessage& member(size_t index) const { return members_[index]; }
+
+  // Returns -1 if the node isn't a member.
+  int IndexOf(uint64_t node_id) const;
+  bool Contains(uint64_t node_id) const { return IndexOf(node_id) >= 0; }
+
+  size_t Phase1Size() const { return phase1_; }
+  size_t Phase2Size() const { return phase2_; }
+
+ private:
+  uint64_t version_;
+  std::vector<uint64_t> nodes_;
+  std::vector<MemberMessage> members_;
+  size_t phase1_;
+  size_t phase2_;
+
+  // No copying allowed
+  MembershipView(const MembershipView&);
+  void operator=(const MembershipView&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_MACHINE_MEMBERSHIP_VIEW_H_
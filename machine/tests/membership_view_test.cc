@@ -0,0 +1,103 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "machine/membership_view.h"
+#include "proto/paxos.pb.h"
+#include "util/testharness.h"
+
+namespace skywalker {
+
+static void AddMember(Membership* membership, uint64_t id) {
+  MemberMessage member;
+  member.set_id(id);
+  member.set_port(static_cast<uint32_t>(id));
+  (*membership->mutable_members())[id] = member;
+}
+
+TEST(MembershipViewTest, IsValid) {
+  // 0 means the majority.
+  CHECK(MembershipView::IsValid(1, 0, 0));
+  CHECK(MembershipView::IsValid(3, 0, 0));
+  CHECK(MembershipView::IsValid(4, 0, 0));
+  CHECK(MembershipView::IsValid(5, 0, 0));
+
+  // Every phase 1 quorum must intersect every phase 2 quorum.
+  CHECK(MembershipView::IsValid(5, 4, 2));
+  CHECK(MembershipView::IsValid(5, 2, 4));
+  CHECK(MembershipView::IsValid(5, 5, 1));
+  CHECK(!MembershipView::IsValid(5, 3, 2));
+  CHECK(!MembershipView::IsValid(5, 2, 2));
+  CHECK(MembershipView::IsValid(4, 3, 2));
+  CHECK(!MembershipView::IsValid(4, 2, 2));
+
+  // One phase of the given size and the other of the majority.
+  CHECK(MembershipView::IsValid(5, 0, 3));
+  CHECK(!MembershipView::IsValid(5, 0, 2));
+  CHECK(MembershipView::IsValid(5, 4, 0));
+
+  // A quorum can't be larger than the members.
+  CHECK(!MembershipView::IsValid(3, 4, 1));
+  CHECK(!MembershipView::IsValid(3, 1, 4));
+  CHECK(!MembershipView::IsValid(0, 0, 0));
+}
+
+TEST(MembershipViewTest, View) {
+  Membership membership;
+  membership.set_version(7);
+  AddMember(&membership, 300);
+  AddMember(&membership, 100);
+  AddMember(&membership, 500);
+  AddMember(&membership, 200);
+  AddMember(&membership, 400);
+
+  MembershipView view(membership, 4, 2);
+  CHECK(view.version() == 7);
+  CHECK(view.size() == 5);
+  CHECK(view.Phase1Size() == 4);
+  CHECK(view.Phase2Size() == 2);
+
+  // The members are sorted by the node id.
+  for (size_t i = 0; i < view.size(); ++i) {
+    uint64_t id = (i + 1) * 100;
+    CHECK(view.node_id(i) == id);
+    CHECK(view.member(i).id() == id);
+    CHECK(view.member(i).port() == id);
+    CHECK(view.IndexOf(id) == static_cast<int>(i));
+    CHECK(view.Contains(id));
+  }
+  CHECK(view.IndexOf(50) == -1);
+  CHECK(view.IndexOf(250) == -1);
+  CHECK(view.IndexOf(600) == -1);
+  CHECK(!view.Contains(600));
+}
+
+// The sizes which don't fit the members are replaced by the majority.
+TEST(MembershipViewTest, Fallback) {
+  Membership membership;
+  for (uint64_t id = 1; id <= 5; ++id) {
+    AddMember(&membership, id);
+  }
+  MembershipView invalid(membership, 2, 2);
+  CHECK(invalid.Phase1Size() == 3);
+  CHECK(invalid.Phase2Size() == 3);
+
+  MembershipView majority(membership, 0, 0);
+  CHECK(majority.Phase1Size() == 3);
+  CHECK(majority.Phase2Size() == 3);
+
+  MembershipView mixed(membership, 0, 3);
+  CHECK(mixed.Phase1Size() == 3);
+  CHECK(mixed.Phase2Size() == 3);
+
+  // After two members leave, the sizes 4 and 2 don't fit anymore.
+  membership.mutable_members()->erase(4);
+  membership.mutable_members()->erase(5);
+  MembershipView shrunk(membership, 4, 2);
+  CHECK(shrunk.Phase1Size() == 2);
+  CHECK(shrunk.Phase2Size() == 2);
+}
+
+}  // namespace skywalker
+
+int main() { return skywalker::test::RunAllTests(); }
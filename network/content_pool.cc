@@ -0,0 +1,52 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "network/content_pool.h"
+
+#include "util/mutexlock.h"
+
+namespace skywalker {
+
+void ContentDeleter::operator()(Content* c) const {
+  ContentPool::Instance()->Release(c);
+}
+
+ContentPool::ContentPool() : mutex_() {}
+
+ContentPool::~ContentPool() {
+  for (auto c : contents_) {
+    delete c;
+  }
+}
+
+ContentPtr ContentPool::Get() {
+  Content* c = nullptr;
+  {
+    MutexLock lock(&mutex_);
+    if (!contents_.empty()) {
+      c = contents_.back();
+      contents_.pop_back();
+    }
+  }
+  if (c == nullptr) {
+    c = new Content();
+  }
+  return ContentPtr(c);
+}
+
+void ContentPool::Release(Content* c) {
+  // Don't keep the large contents, such as the checkpoint files and the
+  // large values, they are rare.
+  if (c->ByteSizeLong() <= kMaxContentSize) {
+    c->Clear();
+    MutexLock lock(&mutex_);
+    if (contents_.size() < kMaxPoolSize) {
+      contents_.push_back(c);
+      return;
+    }
+  }
+  delete c;
+}
+
+}  // namespace skywalker
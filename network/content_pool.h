@@ -0,0 +1,57 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_NETWORK_CONTENT_POOL_H_
+#define SKYWALKER_NETWORK_CONTENT_POOL_H_
+
+#include <memory>
+#include <vector>
+
+#include "proto/paxos.pb.h"
+#include "util/mutex.h"
+
+namespace skywalker {
+
+struct ContentDeleter {
+  void operator()(Content* c) const;
+};
+
+// The content is given back to the pool when it is released.
+typedef std::unique_ptr<Content, ContentDeleter> ContentPtr;
+
+// Keeps the released contents. The Clear() of a message keeps the memory
+// of its strings and sub-messages, so a content taken from the pool is
+// usually parsed or built without allocating any memory.
+class ContentPool {
+ public:
+  static ContentPool* Instance() {
+    static ContentPool pool;
+    return &pool;
+  }
+
+  // The returned content is empty.
+  ContentPtr Get();
+
+ private:
+  friend struct ContentDeleter;
+
+  static const size_t kMaxPoolSize = 1024;
+  static const size_t kMaxContentSize = 64 * 1024;
+
+  ContentPool();
+  ~ContentPool();
+
+  void Release(Content* c);
+
+  Mutex mutex_;
+  std::vector<Content*> contents_;
+
+  // No copying allowed
+  ContentPool(const ContentPool&);
+  void operator=(const ContentPool&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_NETWORK_CONTENT_POOL_H_
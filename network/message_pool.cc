@@ -0,0 +1,48 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "network/message_pool.h"
+
+#include "util/mutexlock.h"
+
+namespace skywalker {
+
+MessagePool::MessagePool() : mutex_() {}
+
+MessagePool::~MessagePool() {
+  for (auto s : buffers_) {
+    delete s;
+  }
+}
+
+std::shared_ptr<std::string> MessagePool::Get() {
+  std::string* s = nullptr;
+  {
+    MutexLock lock(&mutex_);
+    if (!buffers_.empty()) {
+      s = buffers_.back();
+      buffers_.pop_back();
+    }
+  }
+  if (s == nullptr) {
+    s = new std::string();
+  }
+  return std::shared_ptr<std::string>(
+      s, [this](std::string* buf) { Release(buf); });
+}
+
+void MessagePool::Release(std::string* s) {
+  // Don't keep the large buffers, they are rare.
+  if (s->capacity() <= kMaxBufferSize) {
+    s->clear();
+    MutexLock lock(&mutex_);
+    if (buffers_.size() < kMaxPoolSize) {
+      buffers_.push_back(s);
+      return;
+    }
+  }
+  delete s;
+}
+
+}  // namespace skywalker
@@ -0,0 +1,47 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_NETWORK_MESSAGE_POOL_H_
+#define SKYWALKER_NETWORK_MESSAGE_POOL_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "util/mutex.h"
+
+namespace skywalker {
+
+// A serialized message which is immutable after it has been built, so it
+// can be shared by all the connections which it is sent to.
+typedef std::shared_ptr<const std::string> MessagePtr;
+
+// Keeps the buffers of the released messages, so that a new message can
+// reuse the memory instead of allocating it again.
+class MessagePool {
+ public:
+  MessagePool();
+  ~MessagePool();
+
+  // The returned buffer is empty, and it will be given back to the pool
+  // when the last MessagePtr of it is released.
+  std::shared_ptr<std::string> Get();
+
+ private:
+  static const size_t kMaxPoolSize = 256;
+  static const size_t kMaxBufferSize = 1024 * 1024;
+
+  void Release(std::string* s);
+
+  Mutex mutex_;
+  std::vector<std::string*> buffers_;
+
+  // No copying allowed
+  MessagePool(const MessagePool&);
+  void operator=(const MessagePool&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_NETWORK_MESSAGE_POOL_H_
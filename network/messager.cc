@@ -20,16 +20,28 @@ void Messager::SendMessage(uint64_t node_id, const Content& content) {
   network_->SendMessage(node_id, config_, content);
 }
 
+void Messager::SendMessage(uint64_t node_id, const Content& content,
+                           const Slice& data) {
+  assert(node_id != 0);
+  assert(node_id != config_->GetNodeId());
+  network_->SendMessage(node_id, config_, content, data);
+}
+
 void Messager::BroadcastMessage(const Content& content) {
-  std::shared_ptr<Membership> temp = config_->GetMembership();
-  if (temp->members().size() > 0) {
-    network_->SendMessage(temp, content);
+  BroadcastMessage(config_->GetView(), content);
+}
+
+void Messager::BroadcastMessage(
+    const std::shared_ptr<const MembershipView>& view,
+    const Content& content) {
+  if (view->size() > 0) {
+    network_->SendMessage(view, content);
   }
 }
 
 void Messager::BroadcastMessageToFollower(const Content& content) {
-  std::shared_ptr<Membership> temp = config_->GetFollowers();
-  if (temp->members().size() > 0) {
+  std::shared_ptr<const MembershipView> temp = config_->GetFollowers();
+  if (temp->size() > 0) {
     network_->SendMessage(temp, content);
   }
 }
@@ -6,7 +6,9 @@
 #define SKYWALKER_NETWORK_MESSAGER_H_
 
 #include <stdint.h>
+#include <memory>
 
+#include "machine/membership_view.h"
 #include "network/network.h"
 #include "proto/paxos.pb.h"
 
@@ -19,7 +21,11 @@ class Messager {
   Messager(Config* config, Network* network);
 
   void SendMessage(uint64_t node_id, const Content& content);
+  void SendMessage(uint64_t node_id, const Content& content,
+                   const Slice& data);
   void BroadcastMessage(const Content& content);
+  void BroadcastMessage(const std::shared_ptr<const MembershipView>& view,
+                        const Content& content);
   void BroadcastMessageToFollower(const Content& content);
 
  private:
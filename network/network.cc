@@ -7,23 +7,47 @@
 #include <string.h>
 #include <utility>
 
+#include <google/protobuf/io/coded_stream.h>
+
 #include "paxos/config.h"
 #include "skywalker/logging.h"
 #include "util/coding.h"
+#include "util/compression.h"
+#include "util/mutexlock.h"
 
 namespace skywalker {
 
-Network::Network(const Member& my) : my_(my), net_loop_(voyager::kPoll) {
-  loop_ = net_loop_.Loop();
+Network::Network(const Options& options)
+    : my_(options.my),
+      compression_(options.compression == kSnappyCompression &&
+                   SnappySupported()),
+      compression_threshold_(options.compression_threshold),
+      thread_size_(options.network_thread_size > 0
+                       ? options.network_thread_size
+                       : 1) {
+  for (uint32_t i = 0; i < thread_size_; ++i) {
+    std::unique_ptr<Shard> shard(new Shard());
+    shard->net_loop.reset(new voyager::BGEventLoop(voyager::kEpoll));
+    shard->loop = shard->net_loop->Loop();
+    shard->scheduled = false;
+    shards_.push_back(std::move(shard));
+  }
+  Content content;
+  content.set_type(HANDSHAKE);
+  content.set_group_id(kHandshakeGroupId);
+  handshake_ = Serialize(content);
 }
 
 Network::~Network() {}
 
-void Network::StartServer(
-    const std::function<void(std::unique_ptr<Content>)>& cb) {
+void Network::StartServer(const std::function<void(Contents*)>& cb) {
   cb_ = cb;
   voyager::SockAddr addr(my_.host, my_.port);
-  server_.reset(new voyager::TcpServer(loop_, addr, "SkywalkerServer"));
+  server_.reset(new voyager::TcpServer(shards_[0]->loop, addr,
+                                       "SkywalkerServer",
+                                       static_cast<int>(thread_size_)));
+  // The messages are parsed in the loops of the connections, and the
+  // contents are handed to the io loops of their groups directly.
   server_->SetMessageCallback(
       [this](const voyager::TcpConnectionPtr& p, voyager::Buffer* buf) {
         OnMessage(p, buf);
@@ -32,114 +56,317 @@ void Network::StartServer(
   server_->Start();
 }
 
+Network::Shard* Network::GetShard(uint64_t node_id) const {
+  return shards_[node_id % shards_.size()].get();
+}
+
 void Network::SendMessage(uint64_t node_id, Config* config,
                           const Content& content) {
-  std::string* s = new std::string();
-  if (!SerializeToString(content, s)) {
-    delete s;
-    return;
+  Enqueue(node_id, Serialize(content), config, nullptr, 0);
+}
+
+void Network::SendMessage(uint64_t node_id, Config* config,
+                          const Content& content, const Slice& data) {
+  Enqueue(node_id, Serialize(content, data), config, nullptr, 0);
+}
+
+void Network::SendMessage(const std::shared_ptr<const MembershipView>& view,
+                          const Content& content) {
+  // All the connections share the same message.
+  MessagePtr s = Serialize(content);
+  for (size_t i = 0; i < view->size(); ++i) {
+    if (view->node_id(i) != my_.id) {
+      Enqueue(view->node_id(i), s, nullptr, view, i);
+    }
   }
-  loop_->QueueInLoop([this, node_id, config, s]() {
-    auto it = connection_map_.find(node_id);
-    if (it != connection_map_.end()) {
-      voyager::TcpConnectionPtr p = it->second->GetTcpConnectionPtr();
-      if (p) {
-        p->SendMessage(*s);
-      } else {
-        std::shared_ptr<Membership> temp = config->GetMembership();
-        if (temp->members().find(node_id) == temp->members().end()) {
-          it->second->Close();
-          connection_map_.erase(it);
-        }
-      }
-    } else {
-      std::shared_ptr<Membership> temp = config->GetMembership();
-      auto iter = temp->members().find(node_id);
-      if (iter != temp->members().end()) {
-        SendMessageInLoop(iter->second, *s);
+}
+
+// The messages to a peer are queued until its shard runs the flush, so all
+// the messages which are sent in the meantime are written at one time.
+void Network::Enqueue(uint64_t node_id, const MessagePtr& s, Config* config,
+                      const std::shared_ptr<const MembershipView>& view,
+                      size_t index) {
+  Shard* shard = GetShard(node_id);
+  bool schedule = false;
+  {
+    MutexLock lock(&shard->mutex);
+    Outbound& o = shard->outbounds[node_id];
+    o.messages.push_back(s);
+    if (config != nullptr) {
+      o.config = config;
+    }
+    if (view && !o.view) {
+      o.view = view;
+      o.index = index;
+    }
+    if (!shard->scheduled) {
+      shard->scheduled = true;
+      schedule = true;
+    }
+  }
+  if (schedule) {
+    shard->loop->QueueInLoop([this, shard]() { FlushInLoop(shard); });
+  }
+}
+
+// A message which is sent to several peers of the shard is compressed
+// only once in the flush.
+void Network::FlushInLoop(Shard* shard) {
+  std::map<uint64_t, Outbound> outbounds;
+  {
+    MutexLock lock(&shard->mutex);
+    outbounds.swap(shard->outbounds);
+    shard->scheduled = false;
+  }
+  CompressedMap compressed;
+  for (auto& o : outbounds) {
+    SendMessageInLoop(shard, o.first, o.second, &compressed);
+  }
+}
+
+void Network::SendMessageInLoop(Shard* shard, uint64_t node_id,
+                                const Outbound& o,
+                                CompressedMap* compressed) {
+  auto it = shard->connection_map.find(node_id);
+  if (it != shard->connection_map.end()) {
+    voyager::TcpConnectionPtr p = it->second->GetTcpConnectionPtr();
+    if (p && shard->compressions.count(node_id) > 0) {
+      WriteInLoop(p, Compress(o.messages, compressed));
+    } else if (p) {
+      WriteInLoop(p, o.messages);
+    } else if (o.config != nullptr) {
+      if (!o.config->GetView()->Contains(node_id)) {
+        it->second->Close();
+        shard->connection_map.erase(it);
       }
     }
-    delete s;
-  });
+  } else if (o.view) {
+    ConnectInLoop(shard, o.view->member(o.index), o.messages);
+  } else if (o.config != nullptr) {
+    std::shared_ptr<const MembershipView> view = o.config->GetView();
+    int index = view->IndexOf(node_id);
+    if (index >= 0) {
+      ConnectInLoop(shard, view->member(index), o.messages);
+    }
+  }
 }
 
-void Network::SendMessage(const std::shared_ptr<Membership>& m,
-                          const Content& content) {
-  std::string* s = new std::string();
-  if (!SerializeToString(content, s)) {
-    delete s;
+void Network::WriteInLoop(const voyager::TcpConnectionPtr& p,
+                          const std::vector<MessagePtr>& messages) {
+  if (messages.size() == 1) {
+    p->SendMessage(*messages[0]);
     return;
   }
-  loop_->QueueInLoop([this, m, s]() {
-    for (auto& i : m->members()) {
-      if (i.first != my_.id) {
-        auto it = connection_map_.find(i.first);
-        if (it != connection_map_.end()) {
-          voyager::TcpConnectionPtr p = it->second->GetTcpConnectionPtr();
-          if (p) {
-            p->SendMessage(*s);
-          }
-        } else {
-          SendMessageInLoop(i.second, *s);
-        }
+  std::shared_ptr<std::string> buf = pool_.Get();
+  for (auto& m : messages) {
+    if (m->size() >= kMaxCoalesceSize) {
+      if (!buf->empty()) {
+        p->SendMessage(*buf);
+        buf->clear();
       }
+      p->SendMessage(*m);
+    } else {
+      buf->append(*m);
     }
-    delete s;
-  });
+  }
+  if (!buf->empty()) {
+    p->SendMessage(*buf);
+  }
 }
 
-void Network::SendMessageInLoop(const MemberMessage& member,
-                                const std::string& s) {
+void Network::ConnectInLoop(Shard* shard, const MemberMessage& member,
+                            const std::vector<MessagePtr>& messages) {
   uint64_t node_id = member.id();
   voyager::SockAddr addr(member.host(), static_cast<uint16_t>(member.port()));
   std::unique_ptr<voyager::TcpClient> client(
-      new voyager::TcpClient(loop_, addr, "SkywalkerClient"));
+      new voyager::TcpClient(shard->loop, addr, "SkywalkerClient"));
 
+  // The messages are sent uncompressed until the peer agrees.
   client->SetConnectionCallback(
-      [s](const voyager::TcpConnectionPtr& p) { p->SendMessage(s); });
+      [this, messages](const voyager::TcpConnectionPtr& p) {
+        SendHandshake(p);
+        WriteInLoop(p, messages);
+      });
 
-  client->SetCloseCallback([this, node_id](const voyager::TcpConnectionPtr& p) {
-    connection_map_.erase(node_id);
-  });
+  client->SetMessageCallback(
+      [this, shard, node_id](const voyager::TcpConnectionPtr& p,
+                             voyager::Buffer* buf) {
+        OnHandshake(shard, node_id, buf);
+      });
 
-  client->SetConnectFailureCallback(
-      [this, node_id]() { connection_map_.erase(node_id); });
+  client->SetCloseCallback(
+      [shard, node_id](const voyager::TcpConnectionPtr& p) {
+        shard->connection_map.erase(node_id);
+        shard->compressions.erase(node_id);
+      });
+
+  client->SetConnectFailureCallback([shard, node_id]() {
+    shard->connection_map.erase(node_id);
+    shard->compressions.erase(node_id);
+  });
 
   client->Connect(true);
-  connection_map_.insert(std::make_pair(node_id, std::move(client)));
+  shard->connection_map.insert(std::make_pair(node_id, std::move(client)));
+}
+
+MessagePtr Network::Serialize(const Content& content) {
+  std::shared_ptr<std::string> s = pool_.Get();
+  size_t size = content.ByteSizeLong();
+  s->resize(kHeaderSize + size);
+  char* p = &(*s)[0];
+  EncodeFixed32(p, static_cast<uint32_t>(kHeaderSize + size));
+  // The size has been cached by ByteSizeLong.
+  content.SerializeWithCachedSizesToArray(
+      reinterpret_cast<uint8_t*>(p + kHeaderSize));
+  return s;
 }
 
-bool Network::SerializeToString(const Content& content, std::string* s) {
-  uint32_t size = kHeaderSize + static_cast<uint32_t>(content.ByteSizeLong());
-  s->reserve(size);
-  PutFixed32(s, size);
-  bool res = content.AppendToString(s);
-  if (!res) {
-    LOG_ERROR("Network::SendMessage - content serialize to string failed.");
+// The data is encoded as another checkpoint_msg which only has the data
+// field, the parser merges it into the checkpoint_msg of the content.
+MessagePtr Network::Serialize(const Content& content, const Slice& data) {
+  using google::protobuf::io::CodedOutputStream;
+  const uint32_t kLengthDelimited = 2;
+  uint32_t data_tag =
+      (CheckpointMessage::kDataFieldNumber << 3) | kLengthDelimited;
+  uint32_t msg_tag =
+      (Content::kCheckpointMsgFieldNumber << 3) | kLengthDelimited;
+  uint32_t data_size = static_cast<uint32_t>(data.size());
+  uint32_t msg_size = static_cast<uint32_t>(
+      CodedOutputStream::VarintSize32(data_tag) +
+      CodedOutputStream::VarintSize32(data_size) + data_size);
+
+  std::shared_ptr<std::string> s = pool_.Get();
+  size_t size = content.ByteSizeLong() +
+                CodedOutputStream::VarintSize32(msg_tag) +
+                CodedOutputStream::VarintSize32(msg_size) + msg_size;
+  s->resize(kHeaderSize + size);
+  char* p = &(*s)[0];
+  EncodeFixed32(p, static_cast<uint32_t>(kHeaderSize + size));
+  uint8_t* target = content.SerializeWithCachedSizesToArray(
+      reinterpret_cast<uint8_t*>(p + kHeaderSize));
+  target = CodedOutputStream::WriteTagToArray(msg_tag, target);
+  target = CodedOutputStream::WriteVarint32ToArray(msg_size, target);
+  target = CodedOutputStream::WriteTagToArray(data_tag, target);
+  target = CodedOutputStream::WriteVarint32ToArray(data_size, target);
+  memcpy(target, data.data(), data.size());
+  return s;
+}
+
+// Since the checkpoint files are often compressed already, the compressed
+// message is used only if it saves at least 1/8 of the bytes.
+MessagePtr Network::Compress(const MessagePtr& m) {
+  size_t size = m->size() - kHeaderSize;
+  std::shared_ptr<std::string> c = pool_.Get();
+  c->resize(kHeaderSize);
+  if (!SnappyCompress(m->data() + kHeaderSize, size, c.get()) ||
+      c->size() - kHeaderSize >= size - size / 8) {
+    return m;
+  }
+  EncodeFixed32(&(*c)[0], static_cast<uint32_t>(c->size()) | kCompressedFlag);
+  return c;
+}
+
+// For the peers which have agreed to the compression.
+std::vector<MessagePtr> Network::Compress(
+    const std::vector<MessagePtr>& messages, CompressedMap* compressed) {
+  std::vector<MessagePtr> result;
+  result.reserve(messages.size());
+  for (auto& m : messages) {
+    if (m->size() - kHeaderSize < compression_threshold_) {
+      result.push_back(m);
+      continue;
+    }
+    MessagePtr& c = (*compressed)[m.get()];
+    if (!c) {
+      c = Compress(m);
+    }
+    result.push_back(c);
   }
-  return res;
+  return result;
 }
 
+void Network::SendHandshake(const voyager::TcpConnectionPtr& p) {
+  if (compression_) {
+    p->SendMessage(*handshake_);
+  }
+}
+
+// Only the handshake is sent back by the server, and the older nodes
+// send nothing back.
+void Network::OnHandshake(Shard* shard, uint64_t node_id,
+                          voyager::Buffer* buf) {
+  while (buf->ReadableSize() >= kHeaderSize) {
+    uint32_t size = DecodeFixed32(buf->Peek());
+    if (size < kHeaderSize || (size & kCompressedFlag) != 0) {
+      buf->RetrieveAll();
+      break;
+    }
+    if (buf->ReadableSize() < static_cast<size_t>(size)) {
+      break;
+    }
+    Content c;
+    if (c.ParseFromArray(buf->Peek() + kHeaderSize,
+                         static_cast<int>(size - kHeaderSize)) &&
+        c.type() == HANDSHAKE) {
+      shard->compressions.insert(node_id);
+    }
+    buf->Retrieve(size);
+  }
+}
+
+// Parse all the messages in the buffer before handing them over, so that
+// the contents of the same group can be queued to its loop at one time.
 void Network::OnMessage(const voyager::TcpConnectionPtr& p,
                         voyager::Buffer* buf) {
-  bool res = true;
-  while (res) {
-    if (buf->ReadableSize() >= kHeaderSize) {
-      uint32_t size = DecodeFixed32(buf->Peek());
-      if (buf->ReadableSize() >= static_cast<size_t>(size)) {
-        std::unique_ptr<Content> c(new Content());
-        res = c->ParseFromArray(buf->Peek() + kHeaderSize, size - kHeaderSize);
-        if (res) {
-          cb_(std::move(c));
-          buf->Retrieve(size);
-        } else {
-          LOG_ERROR("Network::OnMessage - content parse from array failed.");
-          p->ShutDown();
-        }
-        continue;
+  Contents contents;
+  std::string uncompressed;
+  while (buf->ReadableSize() >= kHeaderSize) {
+    uint32_t header = DecodeFixed32(buf->Peek());
+    uint32_t size = header & ~kCompressedFlag;
+    if (size < kHeaderSize) {
+      LOG_ERROR("Network::OnMessage - invalid message size %u.", size);
+      p->ShutDown();
+      break;
+    }
+    if (buf->ReadableSize() < static_cast<size_t>(size)) {
+      break;
+    }
+    const char* data = buf->Peek() + kHeaderSize;
+    size_t n = size - kHeaderSize;
+    if ((header & kCompressedFlag) != 0) {
+      size_t length = 0;
+      if (!SnappyGetUncompressedLength(data, n, &length)) {
+        LOG_ERROR("Network::OnMessage - invalid compressed message.");
+        p->ShutDown();
+        break;
+      }
+      uncompressed.resize(length);
+      if (!SnappyUncompress(data, n, &uncompressed[0])) {
+        LOG_ERROR("Network::OnMessage - uncompress message failed.");
+        p->ShutDown();
+        break;
       }
+      data = uncompressed.data();
+      n = length;
     }
-    break;
+    ContentPtr c = ContentPool::Instance()->Get();
+    if (!c->ParseFromArray(data, static_cast<int>(n))) {
+      LOG_ERROR("Network::OnMessage - content parse from array failed.");
+      p->ShutDown();
+      break;
+    }
+    buf->Retrieve(size);
+    if (c->type() == HANDSHAKE) {
+      // Agree to the compression if the messages can be uncompressed.
+      if (SnappySupported()) {
+        p->SendMessage(*handshake_);
+      }
+      continue;
+    }
+    contents.push_back(std::move(c));
+  }
+  if (!contents.empty()) {
+    cb_(&contents);
   }
 }
 
@@ -8,7 +8,9 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <voyager/core/bg_eventloop.h>
 #include <voyager/core/buffer.h>
@@ -17,40 +19,119 @@
 #include <voyager/core/tcp_client.h>
 #include <voyager/core/tcp_server.h>
 
+#include "machine/membership_view.h"
+#include "network/content_pool.h"
+#include "network/message_pool.h"
 #include "proto/paxos.pb.h"
 #include "skywalker/options.h"
 #include "skywalker/slice.h"
+#include "util/mutex.h"
 
 namespace skywalker {
 
 class Config;
 
+// The contents which are received from a connection at one time, they
+// are taken from the ContentPool and go back to it when released.
+typedef std::vector<ContentPtr> Contents;
+
 class Network {
  public:
-  explicit Network(const Member& my);
+  // The peer connections are sharded across network_thread_size loops by
+  // the node id, and the server dispatches its connections to
+  // network_thread_size loops which parse the messages.
+  explicit Network(const Options& options);
   ~Network();
 
-  void StartServer(const std::function<void(std::unique_ptr<Content>)>& cb);
+  void StartServer(const std::function<void(Contents*)>& cb);
 
   void SendMessage(uint64_t node_id, Config* config, const Content& content);
 
-  void SendMessage(const std::shared_ptr<Membership>& m,
+  // The data is framed as the checkpoint_msg.data of the content without
+  // being copied into the content, which is used by the checkpoint files.
+  void SendMessage(uint64_t node_id, Config* config, const Content& content,
+                   const Slice& data);
+
+  // The peers are taken from the view without looking up the membership.
+  void SendMessage(const std::shared_ptr<const MembershipView>& view,
                    const Content& content);
 
  private:
   static const uint32_t kHeaderSize = 4;
 
-  void SendMessageInLoop(const MemberMessage& member, const std::string& s);
-  bool SerializeToString(const Content& content, std::string* s);
+  // The highest bit of the size in the header marks a compressed message,
+  // which is only sent to the peers that have answered the handshake.
+  static const uint32_t kCompressedFlag = 0x80000000u;
+
+  // The group_id of the handshake, which is not the id of any group.
+  static const uint32_t kHandshakeGroupId = 0xffffffffu;
+
+  // The smaller messages to a peer are copied into one buffer, so they are
+  // written with one call. The larger ones, such as the accepts of large
+  // values, are sent from their shared buffers by themselves.
+  static const size_t kMaxCoalesceSize = 4 * 1024;
+
+  typedef std::map<uint64_t, std::unique_ptr<voyager::TcpClient> >
+      ConnectionMap;
+
+  // The messages which are waiting to be sent to a peer.
+  // The member is view->member(index) if the view is set.
+  struct Outbound {
+    Outbound() : config(nullptr), index(0) {}
+    std::vector<MessagePtr> messages;
+    Config* config;
+    std::shared_ptr<const MembershipView> view;
+    size_t index;
+  };
+
+  struct Shard {
+    voyager::EventLoop* loop;
+    ConnectionMap connection_map;
+    std::unique_ptr<voyager::BGEventLoop> net_loop;
+
+    Mutex mutex;
+    bool scheduled;
+    std::map<uint64_t, Outbound> outbounds;
+
+    // The peers which have agreed to receive the compressed messages.
+    std::set<uint64_t> compressions;
+  };
+
+  // The compressed messages of a flush, by their uncompressed ones.
+  typedef std::map<const std::string*, MessagePtr> CompressedMap;
+
+  Shard* GetShard(uint64_t node_id) const;
+  void Enqueue(uint64_t node_id, const MessagePtr& s, Config* config,
+               const std::shared_ptr<const MembershipView>& view,
+               size_t index);
+  void FlushInLoop(Shard* shard);
+  void SendMessageInLoop(Shard* shard, uint64_t node_id, const Outbound& o,
+                         CompressedMap* compressed);
+  void WriteInLoop(const voyager::TcpConnectionPtr& p,
+                   const std::vector<MessagePtr>& messages);
+  void ConnectInLoop(Shard* shard, const MemberMessage& member,
+                     const std::vector<MessagePtr>& messages);
+  MessagePtr Serialize(const Content& content);
+  MessagePtr Serialize(const Content& content, const Slice& data);
+  MessagePtr Compress(const MessagePtr& m);
+  std::vector<MessagePtr> Compress(const std::vector<MessagePtr>& messages,
+                                   CompressedMap* compressed);
+  void SendHandshake(const voyager::TcpConnectionPtr& p);
+  void OnHandshake(Shard* shard, uint64_t node_id, voyager::Buffer* buf);
   void OnMessage(const voyager::TcpConnectionPtr& p, voyager::Buffer* buf);
 
   Member my_;
-  std::function<void(std::unique_ptr<Content>)> cb_;
+  std::function<void(Contents*)> cb_;
   std::unique_ptr<voyager::TcpServer> server_;
-  std::map<uint64_t, std::unique_ptr<voyager::TcpClient> > connection_map_;
 
-  voyager::EventLoop* loop_;
-  voyager::BGEventLoop net_loop_;
+  MessagePool pool_;
+
+  const bool compression_;
+  const uint32_t compression_threshold_;
+  MessagePtr handshake_;
+
+  const uint32_t thread_size_;
+  std::vector<std::unique_ptr<Shard> > shards_;
 
   // No copying allowed
   Network(const Network&);
@@ -3,6 +3,12 @@
 // found in the LICENSE file.
 
 #include "paxos/acceptor.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "paxos/config.h"
 #include "paxos/instance.h"
 #include "skywalker/logging.h"
@@ -13,8 +19,11 @@ Acceptor::Acceptor(Config* config, Instance* instance)
     : config_(config),
       instance_(instance),
       messager_(config->GetMessager()),
+      io_loop_(nullptr),
       instance_id_(0),
-      log_sync_count_(0) {}
+      log_sync_count_(0),
+      writing_(false),
+      handling_(false) {}
 
 bool Acceptor::Recover(uint64_t* instance_id) {
   if (ReadFromDB()) {
@@ -25,77 +34,222 @@ bool Acceptor::Recover(uint64_t* instance_id) {
 }
 
 void Acceptor::OnPrepare(const PaxosMessage& msg) {
+  if (!IsSameWindow(msg)) {
+    return;
+  }
   if (msg.instance_id() == instance_id_) {
-    Content content;
-    content.set_type(PAXOS_MESSAGE);
-    content.set_group_id(config_->GetGroupId());
-    PaxosMessage* reply_msg = content.mutable_paxos_msg();
-    reply_msg->set_type(PREPARE_REPLY);
-    reply_msg->set_node_id(config_->GetNodeId());
-    reply_msg->set_instance_id(msg.instance_id());
-    reply_msg->set_proposal_id(msg.proposal_id());
-
-    BallotNumber b(msg.proposal_id(), msg.node_id());
-
-    if (b >= promised_ballot_) {
-      promised_ballot_ = b;
-      if (accepted_ballot_.GetProposalId() > 0) {
-        reply_msg->set_pre_accepted_id(accepted_ballot_.GetProposalId());
-        reply_msg->set_pre_accepted_node_id(accepted_ballot_.GetNodeId());
-        *(reply_msg->mutable_value()) = accepted_value_;
+    AddRequest(msg, nullptr);
+  } else if (msg.instance_id() == instance_id_ + 1 &&
+             config_->ProposeWindow() == 1) {
+    NewChosenValue(msg);
+  }
+}
+
+void Acceptor::OnAccpet(const PaxosMessage& msg,
+                        const PaxosValuePtr& value) {
+  if (!IsSameWindow(msg)) {
+    return;
+  }
+  if (msg.instance_id() == instance_id_ || IsInWindow(msg.instance_id())) {
+    AddRequest(msg, value);
+  } else if (msg.instance_id() == instance_id_ + 1 &&
+             config_->ProposeWindow() == 1) {
+    NewChosenValue(msg);
+  }
+}
+
+// The requests which arrive while a round is being written are handled
+// together in the next round.
+void Acceptor::AddRequest(const PaxosMessage& msg,
+                          const PaxosValuePtr& value) {
+  requests_.push_back(Request());
+  Request& r = requests_.back();
+  r.type = msg.type();
+  r.node_id = msg.node_id();
+  r.instance_id = msg.instance_id();
+  r.proposal_id = msg.proposal_id();
+  r.value = value;
+  HandleRequests();
+}
+
+void Acceptor::HandleRequests() {
+  if (handling_) {
+    return;
+  }
+  handling_ = true;
+  while (!writing_ && !requests_.empty()) {
+    std::vector<Request> requests;
+    requests.swap(requests_);
+    std::shared_ptr<Round> round(new Round());
+    round->promised_ballot = promised_ballot_;
+    for (const Request& r : requests) {
+      if (r.type == PREPARE && r.instance_id == instance_id_) {
+        Prepare(r, round.get());
+      } else if (r.type == ACCEPT && (r.instance_id == instance_id_ ||
+                                      IsInWindow(r.instance_id))) {
+        Accept(r, round.get());
       }
-      WriteToDB();
-    } else {
-      reply_msg->set_rejected_id(promised_ballot_.GetProposalId());
     }
 
-    if (msg.node_id() == config_->GetNodeId()) {
-      instance_->OnPaxosMessage(*reply_msg);
-    } else {
-      messager_->SendMessage(msg.node_id(), content);
+    std::vector<std::pair<uint64_t, ContentPtr>> rejections;
+    rejections.swap(round->rejections);
+    if (!round->accepted.empty()) {
+      writing_ = true;
+      writing_ballot_ = round->promised_ballot;
+      WriteToDB(round);
+    }
+    // The rejections change nothing, so they needn't wait for the write.
+    for (auto& r : rejections) {
+      Reply(r.first, *r.second);
     }
-  } else if (msg.instance_id() == instance_id_ + 1) {
-    NewChosenValue(msg);
   }
+  handling_ = false;
 }
 
-void Acceptor::OnAccpet(const PaxosMessage& msg) {
-  if (msg.instance_id() == instance_id_) {
-    Content content;
-    content.set_type(PAXOS_MESSAGE);
-    content.set_group_id(config_->GetGroupId());
-    PaxosMessage* reply_msg = content.mutable_paxos_msg();
-    reply_msg->set_type(ACCEPT_REPLY);
-    reply_msg->set_node_id(config_->GetNodeId());
-    reply_msg->set_instance_id(msg.instance_id());
-    reply_msg->set_proposal_id(msg.proposal_id());
-
-    BallotNumber b(msg.proposal_id(), msg.node_id());
-    if (b >= promised_ballot_) {
-      promised_ballot_ = b;
-      accepted_ballot_ = b;
-      accepted_value_ = msg.value();
-      WriteToDB();
-    } else {
-      reply_msg->set_rejected_id(promised_ballot_.GetProposalId());
+void Acceptor::Prepare(const Request& r, Round* round) {
+  ContentPtr content = NewReply(PREPARE_REPLY, r);
+  PaxosMessage* reply_msg = content->mutable_paxos_msg();
+
+  BallotNumber b(r.proposal_id, r.node_id);
+  if (b >= round->promised_ballot) {
+    round->promised_ballot = b;
+    // The record of the instance is written with the new promise.
+    Accepted* a = Stage(round, instance_id_);
+    if (a->ballot.GetProposalId() > 0) {
+      reply_msg->set_pre_accepted_id(a->ballot.GetProposalId());
+      reply_msg->set_pre_accepted_node_id(a->ballot.GetNodeId());
+      if (a->value) {
+        *(reply_msg->mutable_value()) = *a->value;
+      }
     }
+    // The prepare covers all the later instances in the window.
+    std::map<uint64_t, const Accepted*> later;
+    for (auto& p : pending_) {
+      later[p.first] = &p.second;
+    }
+    for (auto& p : round->accepted) {
+      if (p.first > instance_id_) {
+        later[p.first] = &p.second;
+      }
+    }
+    for (auto& p : later) {
+      PaxosInstance* i = reply_msg->add_accepted_instances();
+      i->set_instance_id(p.first);
+      i->set_accepted_id(p.second->ballot.GetProposalId());
+      i->set_accepted_node_id(p.second->ballot.GetNodeId());
+      *(i->mutable_accepted_value()) = *p.second->value;
+    }
+    round->replies.push_back(std::make_pair(r.node_id, std::move(content)));
+  } else {
+    reply_msg->set_rejected_id(round->promised_ballot.GetProposalId());
+    round->rejections.push_back(std::make_pair(r.node_id, std::move(content)));
+  }
+}
 
-    if (msg.node_id() == config_->GetNodeId()) {
-      instance_->OnPaxosMessage(*reply_msg);
-    } else {
-      messager_->SendMessage(msg.node_id(), content);
+void Acceptor::Accept(const Request& r, Round* round) {
+  ContentPtr content = NewReply(ACCEPT_REPLY, r);
+  BallotNumber b(r.proposal_id, r.node_id);
+  if (b >= round->promised_ballot) {
+    round->promised_ballot = b;
+    Accepted* a = Stage(round, r.instance_id);
+    a->ballot = b;
+    a->value = r.value;
+    round->replies.push_back(std::make_pair(r.node_id, std::move(content)));
+  } else {
+    content->mutable_paxos_msg()->set_rejected_id(
+        round->promised_ballot.GetProposalId());
+    round->rejections.push_back(std::make_pair(r.node_id, std::move(content)));
+  }
+}
+
+// Returns the accepted state of the instance in the round, which starts
+// from the one of the acceptor.
+Acceptor::Accepted* Acceptor::Stage(Round* round, uint64_t instance_id) {
+  auto it = round->accepted.find(instance_id);
+  if (it != round->accepted.end()) {
+    return &it->second;
+  }
+  Accepted& a = round->accepted[instance_id];
+  if (instance_id == instance_id_) {
+    a.ballot = accepted_ballot_;
+    a.value = accepted_value_;
+  } else {
+    auto p = pending_.find(instance_id);
+    if (p != pending_.end()) {
+      a = p->second;
     }
-  } else if (msg.instance_id() == instance_id_ + 1) {
-    NewChosenValue(msg);
   }
+  return &a;
 }
 
+// The instance may go forward while the round is being written, then the
+// states and the replies of the chosen instances are useless.
+void Acceptor::Finish(const std::shared_ptr<Round>& round, bool ok) {
+  writing_ = false;
+  if (ok) {
+    if (round->promised_ballot > promised_ballot_) {
+      promised_ballot_ = round->promised_ballot;
+    }
+    for (auto& a : round->accepted) {
+      if (a.first == instance_id_) {
+        accepted_ballot_ = a.second.ballot;
+        accepted_value_ = a.second.value;
+      } else if (a.first > instance_id_ && a.second.value) {
+        pending_[a.first] = a.second;
+      }
+    }
+    for (auto& r : round->replies) {
+      if (r.second->paxos_msg().instance_id() >= instance_id_) {
+        Reply(r.first, *r.second);
+      }
+    }
+    instance_->OnAcceptorWritten();
+  } else {
+    LOG_ERROR("Group %u - write the accepted states failed, instance_id=%llu.",
+              config_->GetGroupId(), (unsigned long long)instance_id_);
+  }
+  HandleRequests();
+}
+
+void Acceptor::NextInstance() { SkipTo(instance_id_ + 1); }
+
 // Don't reset the promised_ballot_ here so that
 // the proposer can reduce to call prepare function in sometimes.
-void Acceptor::NextInstance() {
-  ++instance_id_;
+void Acceptor::SkipTo(uint64_t instance_id) {
+  instance_id_ = instance_id;
   accepted_ballot_.Reset();
-  accepted_value_.Clear();
+  accepted_value_.reset();
+  while (!pending_.empty() && pending_.begin()->first < instance_id_) {
+    pending_.erase(pending_.begin());
+  }
+  auto it = pending_.find(instance_id_);
+  if (it != pending_.end()) {
+    accepted_ballot_ = it->second.ballot;
+    accepted_value_ = it->second.value;
+    pending_.erase(it);
+  }
+}
+
+// The accept message of the later instances in the propose window
+// can be accepted before the current instance has been chosen.
+bool Acceptor::IsInWindow(uint64_t instance_id) const {
+  return instance_id > instance_id_ &&
+         instance_id < instance_id_ + config_->ProposeWindow();
+}
+
+// A prepare only covers the instances in the window of the acceptor, and
+// the accepts beyond it are dropped, so the proposers with another window
+// are refused.
+bool Acceptor::IsSameWindow(const PaxosMessage& msg) const {
+  uint32_t window = msg.propose_window() > 0 ? msg.propose_window() : 1;
+  if (window != config_->ProposeWindow()) {
+    LOG_ERROR("Group %u - the propose window of node(id=%llu) is %u, "
+              "but ours is %u.",
+              config_->GetGroupId(), (unsigned long long)msg.node_id(),
+              window, config_->ProposeWindow());
+    return false;
+  }
+  return true;
 }
 
 void Acceptor::NewChosenValue(const PaxosMessage& msg) {
@@ -115,30 +269,94 @@ bool Acceptor::ReadFromDB() {
     return false;
   }
 
-  std::string s;
-  res = config_->GetDB()->Get(instance_id_, &s);
-  if (res != 0) {
+  // The instances after the max chosen one may be only accepted, so start
+  // from the first instance which hasn't been chosen. It doesn't depend on
+  // the window, which may have been another one before the restart.
+  PaxosInstance temp;
+  uint64_t chosen_id = 0;
+  uint64_t max_id = instance_id_;
+  res = config_->GetDB()->GetMaxChosenInstanceId(&chosen_id);
+  if (res == -1) {
+    return false;
+  } else if (res == 0 && chosen_id + 1 < max_id) {
+    instance_id_ = chosen_id + 1;
+    for (uint64_t id = instance_id_ + 1; id <= max_id; ++id) {
+      if (ReadFromDB(id, &temp)) {
+        BallotNumber b(temp.promised_id(), temp.promised_node_id());
+        if (b > promised_ballot_) {
+          promised_ballot_ = b;
+        }
+        if (temp.accepted_id() > 0) {
+          Accepted& a = pending_[id];
+          a.ballot.SetProposalId(temp.accepted_id());
+          a.ballot.SetNodeId(temp.accepted_node_id());
+          a.value = NewPaxosValue(temp.mutable_accepted_value());
+        }
+      }
+    }
+    if (!ReadFromDB(instance_id_, &temp)) {
+      return true;
+    }
+  } else if (!ReadFromDB(instance_id_, &temp)) {
     return false;
   }
 
-  PaxosInstance temp;
-  temp.ParseFromString(s);
-  promised_ballot_.SetProposalId(temp.promised_id());
-  promised_ballot_.SetNodeId(temp.promised_node_id());
+  BallotNumber b(temp.promised_id(), temp.promised_node_id());
+  if (b > promised_ballot_) {
+    promised_ballot_ = b;
+  }
   accepted_ballot_.SetProposalId(temp.accepted_id());
   accepted_ballot_.SetNodeId(temp.accepted_node_id());
-  accepted_value_ = temp.accepted_value();
+  accepted_value_ = NewPaxosValue(temp.mutable_accepted_value());
   return true;
 }
 
-bool Acceptor::WriteToDB() {
+bool Acceptor::ReadFromDB(uint64_t instance_id, PaxosInstance* p) {
+  std::string s;
+  int res = config_->GetDB()->Get(instance_id, &s);
+  if (res != 0) {
+    return false;
+  }
+  p->ParseFromString(s);
+  return true;
+}
+
+// The reply is sent after the states are durable. With group commit they
+// are written by the committer, otherwise they are written at once.
+void Acceptor::WriteToDB(const std::shared_ptr<Round>& round) {
+  WriteBatch batch;
   PaxosInstance temp;
-  temp.set_instance_id(instance_id_);
-  temp.set_promised_id(promised_ballot_.GetProposalId());
-  temp.set_promised_node_id(promised_ballot_.GetNodeId());
-  temp.set_accepted_id(accepted_ballot_.GetProposalId());
-  temp.set_accepted_node_id(accepted_ballot_.GetNodeId());
-  *(temp.mutable_accepted_value()) = accepted_value_;
+  std::string s;
+  for (auto& a : round->accepted) {
+    temp.set_instance_id(a.first);
+    temp.set_promised_id(round->promised_ballot.GetProposalId());
+    temp.set_promised_node_id(round->promised_ballot.GetNodeId());
+    temp.set_accepted_id(a.second.ballot.GetProposalId());
+    temp.set_accepted_node_id(a.second.ballot.GetNodeId());
+    if (a.second.value) {
+      ValueLender lender(&temp, a.second.value);
+      temp.SerializeToString(&s);
+    } else {
+      temp.clear_accepted_value();
+      temp.SerializeToString(&s);
+    }
+    batch.Put(a.first, s);
+  }
+  // The instances before the current one have been chosen.
+  if (instance_id_ > 0) {
+    config_->GetDB()->SetMaxChosenInstanceId(instance_id_ - 1, &batch);
+  }
+
+  GroupCommit* commit = config_->GetGroupCommit();
+  if (commit == nullptr || !config_->LogSync()) {
+    Finish(round, WriteToDB(&batch));
+    return;
+  }
+  commit->Write(config_->GetGroupId(), config_->GetDB(), &batch, io_loop_,
+                [this, round](bool ok) { Finish(round, ok); });
+}
+
+bool Acceptor::WriteToDB(WriteBatch* batch) {
   WriteOptions options;
   options.sync = config_->LogSync();
   if (options.sync) {
@@ -149,15 +367,26 @@ bool Acceptor::WriteToDB() {
       options.sync = false;
     }
   }
+  return config_->GetDB()->WriteAccepted(options, batch) == 0;
+}
 
-  int ret =
-      config_->GetDB()->Put(options, instance_id_, temp.SerializeAsString());
-  if (ret == 0) {
-    return true;
+ContentPtr Acceptor::NewReply(PaxosMessageType type, const Request& r) const {
+  ContentPtr content = ContentPool::Instance()->Get();
+  content->set_type(PAXOS_MESSAGE);
+  content->set_group_id(config_->GetGroupId());
+  PaxosMessage* reply_msg = content->mutable_paxos_msg();
+  reply_msg->set_type(type);
+  reply_msg->set_node_id(config_->GetNodeId());
+  reply_msg->set_instance_id(r.instance_id);
+  reply_msg->set_proposal_id(r.proposal_id);
+  return content;
+}
+
+void Acceptor::Reply(uint64_t node_id, const Content& reply) {
+  if (node_id == config_->GetNodeId()) {
+    instance_->OnPaxosMessage(reply.paxos_msg());
   } else {
-    LOG_ERROR("Group %u - write instance_id=%llu to db failed.",
-              config_->GetGroupId(), (unsigned long long)instance_id_);
-    return false;
+    messager_->SendMessage(node_id, reply);
   }
 }
 
@@ -5,10 +5,18 @@
 #ifndef SKYWALKER_PAXOS_ACCEPTOR_H_
 #define SKYWALKER_PAXOS_ACCEPTOR_H_
 
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "network/content_pool.h"
 #include "paxos/ballot_number.h"
+#include "paxos/paxos_value.h"
 #include "proto/paxos.pb.h"
+#include "storage/write_batch.h"
+#include "util/runloop.h"
 
 namespace skywalker {
 
@@ -23,33 +31,90 @@ class Acceptor {
   bool Recover(uint64_t* instance_id);
 
   void SetInstanceId(uint64_t id) { instance_id_ = id; }
+  void SetIOLoop(RunLoop* loop) { io_loop_ = loop; }
 
+  // The states are updated after they are durable.
   const BallotNumber& GetPromisedBallot() const { return promised_ballot_; }
+  // The promise which is durable or being written. The records written by
+  // the learner keep it, so it isn't lost after restarting.
+  const BallotNumber& GetMaxPromisedBallot() const {
+    return writing_ballot_ > promised_ballot_ ? writing_ballot_
+                                              : promised_ballot_;
+  }
   const BallotNumber& GetAcceptedBallot() const { return accepted_ballot_; }
-  const PaxosValue& GetAcceptedValue() const { return accepted_value_; }
+  // Null if no value has been accepted.
+  const PaxosValuePtr& GetAcceptedValue() const { return accepted_value_; }
 
   void OnPrepare(const PaxosMessage& msg);
-  void OnAccpet(const PaxosMessage& msg);
+  // The value of the message is passed separately, so it can be shared.
+  void OnAccpet(const PaxosMessage& msg, const PaxosValuePtr& value);
 
   void NextInstance();
+  // Jump over the instances which are covered by a loaded checkpoint.
+  void SkipTo(uint64_t instance_id);
 
  private:
+  struct Accepted {
+    BallotNumber ballot;
+    PaxosValuePtr value;
+  };
+
+  struct Request {
+    PaxosMessageType type;
+    uint64_t node_id;
+    uint64_t instance_id;
+    uint64_t proposal_id;
+    PaxosValuePtr value;
+  };
+
+  // The requests handled together. Their states are written in one batch
+  // and applied after the batch is durable, then the replies are sent.
+  struct Round {
+    BallotNumber promised_ballot;
+    std::map<uint64_t, Accepted> accepted;
+    std::vector<std::pair<uint64_t, ContentPtr>> replies;
+    std::vector<std::pair<uint64_t, ContentPtr>> rejections;
+  };
+
+  void AddRequest(const PaxosMessage& msg, const PaxosValuePtr& value);
+  void HandleRequests();
+  void Prepare(const Request& r, Round* round);
+  void Accept(const Request& r, Round* round);
+  Accepted* Stage(Round* round, uint64_t instance_id);
+  void Finish(const std::shared_ptr<Round>& round, bool ok);
+
   void NewChosenValue(const PaxosMessage& msg);
+  bool IsInWindow(uint64_t instance_id) const;
+  bool IsSameWindow(const PaxosMessage& msg) const;
 
   bool ReadFromDB();
-  bool WriteToDB();
+  bool ReadFromDB(uint64_t instance_id, PaxosInstance* p);
+  void WriteToDB(const std::shared_ptr<Round>& round);
+  bool WriteToDB(WriteBatch* batch);
+  ContentPtr NewReply(PaxosMessageType type, const Request& r) const;
+  void Reply(uint64_t node_id, const Content& reply);
 
   Config* config_;
   Instance* instance_;
   Messager* messager_;
+  RunLoop* io_loop_;
 
   uint64_t instance_id_;
   uint32_t log_sync_count_;
 
   // Use for all instances
   BallotNumber promised_ballot_;
+  BallotNumber writing_ballot_;
   BallotNumber accepted_ballot_;
-  PaxosValue accepted_value_;
+  PaxosValuePtr accepted_value_;
+
+  // The accepted states of the later instances in the propose window.
+  std::map<uint64_t, Accepted> pending_;
+
+  // The requests wait while a round is being written.
+  std::vector<Request> requests_;
+  bool writing_;
+  bool handling_;
 
   // No copying allowed
   Acceptor(const Acceptor&);
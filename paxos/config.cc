@@ -13,11 +13,19 @@ Config::Config(uint64_t node_id, uint32_t group_id, const GroupOptions& options,
     : node_id_(node_id),
       group_id_(group_id),
       log_sync_(options.log_sync),
+      stable_master_(options.use_master && options.stable_master),
       sync_interval_(options.sync_interval),
       keep_log_count_(options.keep_log_count),
+      propose_window_(options.propose_window > 0 ? options.propose_window : 1),
+      batch_count_(options.batch_count > 0 ? options.batch_count : 1),
+      batch_bytes_(options.batch_bytes),
+      phase1_quorum_(options.phase1_quorum),
+      phase2_quorum_(options.phase2_quorum),
       log_storage_path_(options.log_storage_path),
+      log_storage_type_(options.log_storage_type),
+      segment_size_(options.segment_size),
       machines_(options.machines),
-      followers_(new Membership()),
+      followers_(),
       default_checkpoint_(nullptr),
       checkpoint_(options.checkpoint),
       db_(new DB(this)),
@@ -26,7 +34,8 @@ Config::Config(uint64_t node_id, uint32_t group_id, const GroupOptions& options,
       checkpoint_manager_(new CheckpointManager(this)),
       log_manager_(new LogManager(this)),
       membership_machine_(new MembershipMachine(this, options)),
-      master_machine_(new MasterMachine(this)) {
+      master_machine_(new MasterMachine(this)),
+      group_commit_(nullptr) {
   char name[8];
   if (log_storage_path_[log_storage_path_.size() - 1] != '/') {
     snprintf(name, sizeof(name), "/g%u", group_id_);
@@ -45,14 +54,16 @@ Config::Config(uint64_t node_id, uint32_t group_id, const GroupOptions& options,
     checkpoint_ = default_checkpoint_;
   }
 
+  Membership followers;
   MemberMessage member;
   for (auto& i : options.followers) {
     member.set_id(i.id);
     member.set_host(i.host);
     member.set_port(i.port);
     member.set_context(i.context);
-    (*(followers_->mutable_members()))[member.id()] = member;
+    (*(followers.mutable_members()))[member.id()] = member;
   }
+  followers_.reset(new MembershipView(followers, 0, 0));
 }
 
 Config::~Config() {
@@ -98,11 +109,7 @@ bool Config::Recover() {
 }
 
 bool Config::IsValidNodeId(uint64_t node_id) const {
-  std::shared_ptr<Membership> temp = membership_machine_->GetMembership();
-  if (temp->members().find(node_id) != temp->members().end()) {
-    return true;
-  }
-  return false;
+  return membership_machine_->GetView()->Contains(node_id);
 }
 
 }  // namespace skywalker
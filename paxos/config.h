@@ -18,6 +18,7 @@
 #include "proto/paxos.pb.h"
 #include "skywalker/options.h"
 #include "storage/db.h"
+#include "storage/group_commit.h"
 
 namespace skywalker {
 
@@ -42,11 +43,23 @@ class Config {
   }
   MasterMachine* GetMasterMachine() const { return master_machine_; }
 
+  // Return nullptr if the node doesn't use group commit.
+  GroupCommit* GetGroupCommit() const { return group_commit_; }
+  void SetGroupCommit(GroupCommit* commit) { group_commit_ = commit; }
+
   bool LogSync() const { return log_sync_; }
+  bool StableMaster() const { return stable_master_; }
   uint32_t SyncInterval() const { return sync_interval_; }
   uint32_t KeepLogCount() const { return keep_log_count_; }
+  uint32_t ProposeWindow() const { return propose_window_; }
+  uint32_t BatchCount() const { return batch_count_; }
+  uint32_t BatchBytes() const { return batch_bytes_; }
+  uint32_t Phase1Quorum() const { return phase1_quorum_; }
+  uint32_t Phase2Quorum() const { return phase2_quorum_; }
 
   const std::string& LogStoragePath() const { return log_storage_path_; }
+  LogStorageType GetLogStorageType() const { return log_storage_type_; }
+  uint64_t SegmentSize() const { return segment_size_; }
   const std::string& LogPath() const { return log_path_; }
   const std::string& CheckpointPath() const { return checkpoint_path_; }
 
@@ -58,17 +71,15 @@ class Config {
 
   uint64_t GetNodeId() const { return node_id_; }
 
-  size_t GetNodeSize() const {
-    return membership_machine_->GetMembership()->members().size();
-  }
-  size_t GetMajoritySize() const {
-    return (membership_machine_->GetMembership()->members().size() / 2 + 1);
-  }
-
   std::shared_ptr<Membership> GetMembership() const {
     return membership_machine_->GetMembership();
   }
-  std::shared_ptr<Membership> GetFollowers() const { return followers_; }
+  std::shared_ptr<const MembershipView> GetView() const {
+    return membership_machine_->GetView();
+  }
+  std::shared_ptr<const MembershipView> GetFollowers() const {
+    return followers_;
+  }
 
   bool IsValidNodeId(uint64_t node_id) const;
 
@@ -77,15 +88,23 @@ class Config {
   uint32_t group_id_;
 
   bool log_sync_;
+  bool stable_master_;
   uint32_t sync_interval_;
   uint32_t keep_log_count_;
+  uint32_t propose_window_;
+  uint32_t batch_count_;
+  uint32_t batch_bytes_;
+  uint32_t phase1_quorum_;
+  uint32_t phase2_quorum_;
   std::string log_storage_path_;
+  LogStorageType log_storage_type_;
+  uint64_t segment_size_;
   std::string log_path_;
   std::string checkpoint_path_;
 
   std::vector<StateMachine*> machines_;
 
-  std::shared_ptr<Membership> followers_;
+  std::shared_ptr<const MembershipView> followers_;
 
   Checkpoint* default_checkpoint_;
 
@@ -97,6 +116,7 @@ class Config {
   LogManager* log_manager_;
   MembershipMachine* membership_machine_;
   MasterMachine* master_machine_;
+  GroupCommit* group_commit_;
 
   // No copying allowed
   Config(const Config&);
@@ -3,38 +3,61 @@
 // found in the LICENSE file.
 
 #include "paxos/counter.h"
-#include "paxos/config.h"
 
 namespace skywalker {
 
-Counter::Counter(const Config* config) : config_(config) {}
+void Counter::Votes::Reset(size_t size) {
+  bits_.assign((size + 63) / 64, 0);
+  count_ = 0;
+}
 
-void Counter::AddReceivedNode(uint64_t node_id) {
-  received_nodes_.insert(node_id);
+void Counter::Votes::Add(int index) {
+  uint64_t mask = static_cast<uint64_t>(1) << (index % 64);
+  uint64_t& word = bits_[index / 64];
+  if ((word & mask) == 0) {
+    word |= mask;
+    ++count_;
+  }
 }
 
-void Counter::AddRejector(uint64_t node_id) { rejectors_.insert(node_id); }
+Counter::Counter()
+    : node_size_(static_cast<size_t>(-1)),
+      pass_size_(static_cast<size_t>(-1)),
+      reject_size_(static_cast<size_t>(-1)) {}
 
-void Counter::AddPromisorOrAcceptor(uint64_t node_id) {
-  promisors_or_acceptors_.insert(node_id);
+void Counter::AddReceivedNode(uint64_t node_id) {
+  Add(&received_nodes_, node_id);
 }
 
-bool Counter::IsPassedOnThisRound() const {
-  return (promisors_or_acceptors_.size() >= config_->GetMajoritySize());
-}
+void Counter::AddRejector(uint64_t node_id) { Add(&rejectors_, node_id); }
 
-bool Counter::IsRejectedOnThisRound() const {
-  return (rejectors_.size() >= config_->GetMajoritySize());
+void Counter::AddPromisorOrAcceptor(uint64_t node_id) {
+  Add(&promisors_or_acceptors_, node_id);
 }
 
-bool Counter::IsReceiveAllOnThisRound() const {
-  return (received_nodes_.size() >= config_->GetNodeSize());
+void Counter::Add(Votes* votes, uint64_t node_id) {
+  if (view_) {
+    int index = view_->IndexOf(node_id);
+    if (index >= 0) {
+      votes->Add(index);
+    }
+  }
 }
 
-void Counter::StartNewRound() {
-  received_nodes_.clear();
-  rejectors_.clear();
-  promisors_or_acceptors_.clear();
+// The round can't pass once the rejectors leave less than a quorum.
+void Counter::StartNewRound(const std::shared_ptr<const MembershipView>& view,
+                            Phase phase) {
+  view_ = view;
+  node_size_ = view_->size();
+  if (phase == kPrepare) {
+    pass_size_ = view_->Phase1Size();
+  } else {
+    pass_size_ = view_->Phase2Size();
+  }
+  reject_size_ = node_size_ + 1 - pass_size_;
+  received_nodes_.Reset(node_size_);
+  rejectors_.Reset(node_size_);
+  promisors_or_acceptors_.Reset(node_size_);
 }
 
 }  // namespace skywalker
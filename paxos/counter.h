@@ -6,32 +6,64 @@
 #define SKYWALKER_PAXOS_COUNTER_H_
 
 #include <stdint.h>
-#include <set>
+#include <memory>
+#include <vector>
 
-namespace skywalker {
+#include "machine/membership_view.h"
 
-class Config;
+namespace skywalker {
 
+// Counts the votes of a round. The votes of the nodes which aren't in the
+// view of the round are ignored.
 class Counter {
  public:
-  explicit Counter(const Config* config);
+  enum Phase { kPrepare, kAccept };
+
+  Counter();
 
   void AddReceivedNode(uint64_t node_id);
   void AddRejector(uint64_t node_id);
   void AddPromisorOrAcceptor(uint64_t node_id);
 
-  bool IsPassedOnThisRound() const;
-  bool IsRejectedOnThisRound() const;
-  bool IsReceiveAllOnThisRound() const;
+  bool IsPassedOnThisRound() const {
+    return promisors_or_acceptors_.count() >= pass_size_;
+  }
+  bool IsRejectedOnThisRound() const {
+    return rejectors_.count() >= reject_size_;
+  }
+  bool IsReceiveAllOnThisRound() const {
+    return received_nodes_.count() >= node_size_;
+  }
 
-  void StartNewRound();
+  void StartNewRound(const std::shared_ptr<const MembershipView>& view,
+                     Phase phase);
 
  private:
-  const Config* config_;
+  class Votes {
+   public:
+    Votes() : count_(0) {}
+
+    void Reset(size_t size);
+    void Add(int index);
+    size_t count() const { return count_; }
+
+   private:
+    std::vector<uint64_t> bits_;
+    size_t count_;
+  };
+
+  void Add(Votes* votes, uint64_t node_id);
+
+  std::shared_ptr<const MembershipView> view_;
+
+  // Cached when the round starts.
+  size_t node_size_;
+  size_t pass_size_;
+  size_t reject_size_;
 
-  std::set<uint64_t> received_nodes_;
-  std::set<uint64_t> rejectors_;
-  std::set<uint64_t> promisors_or_acceptors_;
+  Votes received_nodes_;
+  Votes rejectors_;
+  Votes promisors_or_acceptors_;
 
   // Intentionally copyable
 };
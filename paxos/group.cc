@@ -4,6 +4,7 @@
 
 #include "paxos/group.h"
 
+#include <set>
 #include <utility>
 
 #include "skywalker/logging.h"
@@ -24,7 +25,9 @@ Group::Group(uint64_t node_id, uint32_t group_id, const GroupOptions& options,
       mutex_(),
       cond_(&mutex_),
       propose_end_(false),
-      propose_queue_(100) {
+      propose_queue_(100, config_.ProposeWindow()),
+      propose_batcher_(&instance_, &propose_queue_, config_.ProposeWindow(),
+                       config_.BatchCount(), config_.BatchBytes()) {
   propose_cb_ = std::bind(&ProposeQueue::ProposeComplete, &propose_queue_,
                           std::placeholders::_1, std::placeholders::_2,
                           std::placeholders::_3);
@@ -36,15 +39,23 @@ Group::Group(uint64_t node_id, uint32_t group_id, const GroupOptions& options,
 
 Group::~Group() { Schedule::Instance()->MasterLoop()->Remove(timer_); }
 
+// The writes left in the log of group commit are replayed before the
+// acceptor reads its states.
 bool Group::Recover() {
-  if (config_.Recover() && instance_.Recover()) {
-    return true;
+  if (!config_.Recover()) {
+    return false;
   }
-  return false;
+  GroupCommit* commit = config_.GetGroupCommit();
+  if (commit != nullptr &&
+      commit->Replay(config_.GetGroupId(), config_.GetDB()) != 0) {
+    return false;
+  }
+  return instance_.Recover();
 }
 
 void Group::Start(RunLoop* io_loop, RunLoop* callback_loop) {
   io_loop_ = io_loop;
+  callback_loop_ = callback_loop;
   instance_.SetIOLoop(io_loop_);
   propose_queue_.SetIOLoop(io_loop_);
   propose_queue_.SetCallbackLoop(callback_loop);
@@ -77,8 +88,15 @@ void Group::SyncMembership() {
   }
 }
 
+// With a stable master, no other node may propose while its lease lasts,
+// the membership is learned from the master instead.
 void Group::SyncMembershipInLoop() {
-  if (!membership_machine_->HasSyncMembership()) {
+  uint64_t master_id, version;
+  if (config_.StableMaster() &&
+      master_machine_->GetMaster(&master_id, &version) &&
+      master_id != node_id_) {
+    instance_.FinishPropose(Status::NotMaster("there is a master now."));
+  } else if (!membership_machine_->HasSyncMembership()) {
     std::shared_ptr<Membership> temp = membership_machine_->GetMembership();
     MemberChangeMessage message;
     for (auto& i : temp->members()) {
@@ -88,7 +106,7 @@ void Group::SyncMembershipInLoop() {
     instance_.OnPropose(membership_machine_->machine_id(),
                         message.SerializeAsString());
   } else {
-    propose_cb_(instance_.GetInstanceId(), Status::OK(), nullptr);
+    instance_.FinishPropose(Status::OK());
   }
 }
 
@@ -125,6 +143,8 @@ void Group::TryBeMaster() {
       next, [this]() { TryBeMaster(); });
 }
 
+// It isn't refused like the other proposals, it only proposes when there
+// is no master, or to renew the lease of this node.
 void Group::TryBeMasterInLoop() {
   MasterState state(master_machine_->GetMasterState());
   now_ = NowMicros();
@@ -134,35 +154,103 @@ void Group::TryBeMasterInLoop() {
     instance_.OnPropose(master_machine_->machine_id(),
                         state.SerializeAsString(), &now_);
   } else {
-    propose_cb_(instance_.GetInstanceId(),
-                Status::Conflict("Already has master"), nullptr);
+    instance_.FinishPropose(Status::Conflict("Already has master"));
   }
 }
 
 bool Group::OnPropose(uint32_t machine_id, const std::string& value,
                       void* context, const ProposeCompleteCallback& cb) {
-  return propose_queue_.Put(
-      std::bind(&Instance::OnPropose, &instance_, machine_id, value, context),
-      cb);
+  ProposeRequest* r = propose_queue_.NewRequest();
+  r->machine_id = machine_id;
+  r->value.assign(value);
+  r->context = context;
+  r->cb = cb;
+  return OnPropose(r);
 }
 
 bool Group::OnPropose(uint32_t machine_id, const std::string& value,
                       void* context, ProposeCompleteCallback&& cb) {
-  return propose_queue_.Put(
-      std::bind(&Instance::OnPropose, &instance_, machine_id, value, context),
-      std::move(cb));
+  ProposeRequest* r = propose_queue_.NewRequest();
+  r->machine_id = machine_id;
+  r->value.assign(value);
+  r->context = context;
+  r->cb = std::move(cb);
+  return OnPropose(r);
+}
+
+bool Group::OnPropose(uint32_t machine_id, std::string&& value,
+                      void* context, ProposeCompleteCallback&& cb) {
+  ProposeRequest* r = propose_queue_.NewRequest();
+  r->machine_id = machine_id;
+  r->value = std::move(value);
+  r->context = context;
+  r->cb = std::move(cb);
+  return OnPropose(r);
 }
 
-void Group::OnContent(std::unique_ptr<Content> c) {
-  Content* content = c.release();
-  io_loop_->QueueInLoop([content, this]() {
-    instance_.OnContent(*content);
-    delete content;
+bool Group::OnPropose(ProposeRequest* r) {
+  if (config_.BatchCount() > 1) {
+    return propose_batcher_.Put(r);
+  }
+  r->handler = [this, r]() {
+    if (!instance_.RefusePropose(r->context)) {
+      instance_.OnPropose(r->machine_id, std::move(r->value), r->context);
+    }
+  };
+  return propose_queue_.Put(r);
+}
+
+bool Group::ReadIndex(void* context, const ReadIndexCallback& cb) {
+  if (!use_master_ || !config_.StableMaster()) {
+    LOG_WARN("Group %u - You don't use stable master.", config_.GetGroupId());
+    return false;
+  }
+  RunLoop* loop = callback_loop_;
+  ReadIndexCallback f = [loop, cb](uint64_t read_index, const Status& s,
+                                   void* ctx) {
+    loop->QueueInLoop([cb, read_index, s, ctx]() { cb(read_index, s, ctx); });
+  };
+  io_loop_->QueueInLoop(
+      [this, context, f]() { instance_.OnReadIndex(context, f); });
+  return true;
+}
+
+// The contents are moved to the io loop, and they go back to the pool
+// after they are handled.
+void Group::OnContent(Contents* contents) {
+  Contents* temp = new Contents();
+  temp->swap(*contents);
+  io_loop_->QueueInLoop([temp, this]() {
+    for (auto& content : *temp) {
+      instance_.OnContent(content.get());
+    }
+    delete temp;
   });
 }
 
 bool Group::ChangeMember(const std::vector<std::pair<Member, bool>>& value,
                          void* context, const ProposeCompleteCallback& cb) {
+  if (config_.Phase1Quorum() != 0 || config_.Phase2Quorum() != 0) {
+    std::shared_ptr<const MembershipView> view = config_.GetView();
+    std::set<uint64_t> ids;
+    for (size_t i = 0; i < view->size(); ++i) {
+      ids.insert(view->node_id(i));
+    }
+    for (auto& i : value) {
+      if (i.second) {
+        ids.insert(i.first.id);
+      } else {
+        ids.erase(i.first.id);
+      }
+    }
+    if (!MembershipView::IsValid(ids.size(), config_.Phase1Quorum(),
+                                 config_.Phase2Quorum())) {
+      LOG_WARN("Group %u - the quorums don't fit %llu members.",
+               config_.GetGroupId(), (unsigned long long)ids.size());
+      return false;
+    }
+  }
+
   MemberMessage member;
   MemberChangeMessage change;
   for (auto& i : value) {
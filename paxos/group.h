@@ -13,8 +13,10 @@
 
 #include "machine/master_machine.h"
 #include "machine/membership_machine.h"
+#include "network/network.h"
 #include "paxos/config.h"
 #include "paxos/instance.h"
+#include "paxos/propose_batcher.h"
 #include "paxos/propose_queue.h"
 #include "paxos/schedule.h"
 #include "proto/paxos.pb.h"
@@ -34,6 +36,8 @@ class Group {
   bool Recover();
   void Start(RunLoop* io_loop, RunLoop* callback_loop);
 
+  void SetGroupCommit(GroupCommit* commit) { config_.SetGroupCommit(commit); }
+
   void SetNewMembershipCallback(const NewMembershipCallback& cb);
   void SetNewMasterCallback(const NewMasterCallback& cb);
 
@@ -46,7 +50,12 @@ class Group {
   bool OnPropose(uint32_t machine_id, const std::string& value, void* context,
                  ProposeCompleteCallback&& cb);
 
-  void OnContent(std::unique_ptr<Content> c);
+  bool OnPropose(uint32_t machine_id, std::string&& value, void* context,
+                 ProposeCompleteCallback&& cb);
+
+  bool ReadIndex(void* context, const ReadIndexCallback& cb);
+
+  void OnContent(Contents* contents);
 
   bool ChangeMember(const std::vector<std::pair<Member, bool>>& value,
                     void* context, const ProposeCompleteCallback& cb);
@@ -63,6 +72,7 @@ class Group {
   void SyncMembershipInLoop();
   void TryBeMaster();
   void TryBeMasterInLoop();
+  bool OnPropose(ProposeRequest* r);
   bool NewPropose(ProposeHandler&& f);
   void ProposeComplete(uint64_t instance_id, const Status& result,
                        void* context);
@@ -86,7 +96,9 @@ class Group {
   Status result_;
 
   ProposeQueue propose_queue_;
+  ProposeBatcher propose_batcher_;
   RunLoop* io_loop_;
+  RunLoop* callback_loop_;
 
   // No copying allowed
   Group(const Group&);
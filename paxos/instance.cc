@@ -4,24 +4,31 @@
 
 #include "paxos/instance.h"
 
+#include <assert.h>
 #include <stdio.h>
 
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "paxos/config.h"
 #include "skywalker/logging.h"
 #include "util/mutexlock.h"
+#include "util/timeops.h"
 
 namespace skywalker {
 
+// See GroupOptions::stable_master, the clocks may drift apart this much.
+static const uint64_t kReadLeaseMargin = 50 * 1000;
+
 Instance::Instance(Config* config)
     : config_(config),
       acceptor_(config, this),
       learner_(config, this, &acceptor_),
       proposer_(config, this),
       instance_id_(0),
-      is_proposing_(false),
-      context_(nullptr) {}
+      value_id_(NowMicros()),
+      read_id_(0) {}
 
 Instance::~Instance() {}
 
@@ -50,6 +57,7 @@ bool Instance::Recover() {
 
 void Instance::SetIOLoop(RunLoop* loop) {
   io_loop_ = loop;
+  acceptor_.SetIOLoop(loop);
   proposer_.SetIOLoop(loop);
   learner_.SetIOLoop(loop);
 }
@@ -61,40 +69,185 @@ void Instance::SyncData(bool add_timer) {
       [this, add_timer]() { learner_.AskForLearn(add_timer); });
 }
 
-void Instance::OnPropose(uint32_t machine_id, const std::string& value,
+void Instance::OnPropose(uint32_t machine_id, std::string&& value,
                          void* context) {
+  PaxosValue v;
+  v.set_machine_id(machine_id);
+  v.mutable_user_data()->swap(value);
+  OnProposeValue(&v, context);
+}
+
+void Instance::OnProposeValue(PaxosValue* value, void* context) {
   if (!config_->IsValidNodeId(config_->GetNodeId())) {
     Slice msg("this node is not in the membership, please add it firstly.");
-    propose_cb_(instance_id_, Status::InvalidNode(msg), context);
+    FinishPropose(Status::InvalidNode(msg), context);
     return;
   }
 
-  assert(!is_proposing_);
-  is_proposing_ = true;
+  assert(proposals_.size() < config_->ProposeWindow());
+  proposals_.push_back(Proposal());
+  Proposal& p = proposals_.back();
+  p.instance_id = proposer_.GetNextInstanceId();
+  p.context = context;
+  p.value_id = ++value_id_;
+  p.finished = false;
+
+  if (proposals_.size() == 1) {
+    AddProposeTimer();
+  }
+
+  value->set_node_id(config_->GetNodeId());
+  value->set_value_id(p.value_id);
+  proposer_.NewPropose(NewPaxosValue(value));
+}
+
+bool Instance::RefusePropose(void* context) {
+  if (config_->StableMaster() && !config_->GetMasterMachine()->IsMaster()) {
+    FinishPropose(Status::NotMaster("this node isn't the master."), context);
+    return true;
+  }
+  return false;
+}
+
+void Instance::FinishPropose(const Status& status, void* context) {
+  proposals_.push_back(Proposal());
+  Proposal& p = proposals_.back();
+  p.instance_id = instance_id_;
+  p.context = context;
+  p.finished = true;
+  p.status = status;
+  FinishProposals();
+}
 
-  assert(!context_);
-  context_ = context;
-  propose_value_.set_machine_id(machine_id);
-  propose_value_.set_user_data(value);
+void Instance::FinishProposals() {
+  while (!proposals_.empty() && proposals_.front().finished) {
+    const Proposal& p = proposals_.front();
+    propose_cb_(p.instance_id, p.status, p.context);
+    proposals_.pop_front();
+  }
+}
 
+void Instance::AddProposeTimer() {
+  if (io_loop_->Restart(propose_timer_, 1000 * 1000)) {
+    return;
+  }
   propose_timer_ = io_loop_->RunAfter(1000 * 1000, [this]() {
+    propose_timer_ = TimerId();
     proposer_.QuitPropose();
-    is_proposing_ = false;
-    Slice msg("proposal time more than a second.");
-    propose_cb_(instance_id_, Status::Timeout(msg), context_);
-    context_ = nullptr;
+    FailProposals(Status::Timeout("proposal time more than a second."));
+  });
+}
+
+void Instance::FailProposals(const Status& status) {
+  for (auto& p : proposals_) {
+    if (!p.finished) {
+      p.instance_id = instance_id_;
+      p.finished = true;
+      p.status = status;
+    }
+  }
+  FinishProposals();
+}
+
+void Instance::OnReadIndex(void* context, const ReadIndexCallback& cb) {
+  MasterMachine* master = config_->GetMasterMachine();
+  if (master->IsMaster()) {
+    // With a stable master, no other node can choose a value while the
+    // lease lasts. The master executed all the instances before its own
+    // election, and the later ones are its own proposals, so all the
+    // completed proposals have been executed before instance_id_.
+    assert(config_->StableMaster());
+    if (master->IsMaster(kReadLeaseMargin)) {
+      cb(instance_id_, Status::OK(), context);
+    } else {
+      cb(instance_id_, Status::NotMaster("the lease is expiring."), context);
+    }
+    return;
+  }
+
+  uint64_t node_id, version;
+  if (!master->GetMaster(&node_id, &version)) {
+    cb(instance_id_, Status::NotMaster("there is no master now."), context);
+    return;
+  }
+
+  uint64_t id = ++read_id_;
+  Read& read = reads_[id];
+  read.context = context;
+  read.cb = cb;
+
+  Content content;
+  content.set_type(PAXOS_MESSAGE);
+  content.set_group_id(config_->GetGroupId());
+  PaxosMessage* msg = content.mutable_paxos_msg();
+  msg->set_type(READ_INDEX);
+  msg->set_node_id(config_->GetNodeId());
+  msg->set_read_id(id);
+  config_->GetMessager()->SendMessage(node_id, content);
+
+  // Wait a second for the master to answer.
+  read.timer = io_loop_->RunAfter(1000 * 1000, [this, id]() {
+    auto it = reads_.find(id);
+    if (it != reads_.end()) {
+      Read r(std::move(it->second));
+      reads_.erase(it);
+      r.cb(instance_id_, Status::Timeout("the master doesn't answer."),
+           r.context);
+    }
   });
+}
 
-  proposer_.NewPropose(propose_value_);
+void Instance::OnAskForReadIndex(const PaxosMessage& msg) {
+  // Only the stable master answers, the others let the reader time out.
+  if (!config_->StableMaster() ||
+      !config_->GetMasterMachine()->IsMaster(kReadLeaseMargin)) {
+    return;
+  }
+  Content content;
+  content.set_type(PAXOS_MESSAGE);
+  content.set_group_id(config_->GetGroupId());
+  PaxosMessage* reply_msg = content.mutable_paxos_msg();
+  reply_msg->set_type(READ_INDEX_REPLY);
+  reply_msg->set_node_id(config_->GetNodeId());
+  reply_msg->set_read_id(msg.read_id());
+  reply_msg->set_now_instance_id(instance_id_);
+  config_->GetMessager()->SendMessage(msg.node_id(), content);
+}
+
+void Instance::OnReadIndexReply(const PaxosMessage& msg) {
+  auto it = reads_.find(msg.read_id());
+  if (it != reads_.end() && it->second.timer.second != nullptr) {
+    io_loop_->Remove(it->second.timer);
+    it->second.timer = TimerId();
+    waiting_reads_.insert(std::make_pair(msg.now_instance_id(), msg.read_id()));
+  }
 }
 
-void Instance::OnContent(const Content& c) {
-  switch (c.type()) {
+void Instance::CheckReads() {
+  while (!waiting_reads_.empty() &&
+         waiting_reads_.begin()->first <= instance_id_) {
+    auto it = reads_.find(waiting_reads_.begin()->second);
+    waiting_reads_.erase(waiting_reads_.begin());
+    if (it != reads_.end()) {
+      Read r(std::move(it->second));
+      reads_.erase(it);
+      r.cb(instance_id_, Status::OK(), r.context);
+    }
+  }
+}
+
+void Instance::OnContent(Content* c) {
+  switch (c->type()) {
     case PAXOS_MESSAGE:
-      OnPaxosMessage(c.paxos_msg());
+      if (c->paxos_msg().type() == ACCEPT && c->paxos_msg().has_value()) {
+        PaxosValuePtr value(c->mutable_paxos_msg()->release_value());
+        OnPaxosMessage(c->paxos_msg(), value);
+      } else {
+        OnPaxosMessage(c->paxos_msg());
+      }
       break;
     case CHECKPOINT_MESSAGE:
-      OnCheckpointMessage(c.checkpoint_msg());
+      OnCheckpointMessage(c->checkpoint_msg());
       break;
     default:
       LOG_ERROR("Group %u - receive an invalid content.",
@@ -112,7 +265,7 @@ void Instance::OnPaxosMessage(const PaxosMessage& msg) {
       acceptor_.OnPrepare(msg);
       break;
     case ACCEPT:
-      acceptor_.OnAccpet(msg);
+      acceptor_.OnAccpet(msg, std::make_shared<PaxosValue>(msg.value()));
       break;
     case PREPARE_REPLY:
       proposer_.OnPrepareReply(msg);
@@ -129,6 +282,12 @@ void Instance::OnPaxosMessage(const PaxosMessage& msg) {
     case SEND_LEARNED_VALUE:
       learner_.OnSendLearnedValue(msg);
       break;
+    case SEND_LEARNED_VALUES:
+      learner_.OnSendLearnedValues(msg);
+      break;
+    case COMFIRM_LEARNED_VALUES:
+      learner_.OnComfirmLearnedValues(msg);
+      break;
     case SEND_NOW_INSTANCE_ID:
       learner_.OnSendNowInstanceId(msg);
       break;
@@ -138,6 +297,12 @@ void Instance::OnPaxosMessage(const PaxosMessage& msg) {
     case ASK_FOR_CHECKPOINT:
       learner_.OnAskForCheckpoint(msg);
       break;
+    case READ_INDEX:
+      OnAskForReadIndex(msg);
+      break;
+    case READ_INDEX_REPLY:
+      OnReadIndexReply(msg);
+      break;
     default:
       LOG_ERROR("Group %u - receive an invalid paxos message.",
                 config_->GetGroupId());
@@ -145,27 +310,79 @@ void Instance::OnPaxosMessage(const PaxosMessage& msg) {
   }
 
   CheckLearn();
+  CheckReads();
+}
+
+void Instance::OnPaxosMessage(const PaxosMessage& msg,
+                              const PaxosValuePtr& value) {
+  if (learner_.IsReceivingCheckpoint()) {
+    return;
+  }
+  assert(msg.type() == ACCEPT);
+  acceptor_.OnAccpet(msg, value);
+
+  CheckLearn();
+  CheckReads();
+}
+
+void Instance::OnAcceptorWritten() {
+  learner_.CheckChosenValue();
+  CheckLearn();
+  CheckReads();
 }
 
 void Instance::OnCheckpointMessage(const CheckpointMessage& msg) {
   learner_.OnSendCheckpoint(msg);
 }
 
+void Instance::OnLoadCheckpoint(uint64_t instance_id) {
+  uint64_t next = instance_id + 1;
+  if (next <= instance_id_) {
+    return;
+  }
+  instance_id_ = next;
+  acceptor_.SkipTo(next);
+  proposer_.SkipTo(next);
+  // The log before the checkpoint is missing now.
+  config_->GetLogManager()->SetMinChosenInstanceId(next);
+  config_->GetLogManager()->SetMaxChosenInstanceId(instance_id);
+  learner_.SkipTo(next);
+  // The proposals may have been chosen before the checkpoint or not, so
+  // they end like the ones which time out.
+  io_loop_->Remove(propose_timer_);
+  FailProposals(Status::Timeout("a checkpoint has been loaded."));
+  LOG_INFO("Group %u - go on from the checkpoint, now instance_id=%llu.",
+           config_->GetGroupId(), (unsigned long long)instance_id_);
+  CheckReads();
+}
+
 void Instance::CheckLearn() {
-  if (learner_.HasLearned()) {
+  while (learner_.HasLearned()) {
+    if (proposals_.empty()) {
+      if (!ExecuteLearnedValues()) {
+        break;
+      }
+      if (!learner_.HasLearned()) {
+        break;
+      }
+    }
+
     const PaxosValue& learned_value(learner_.GetLearnedValue());
+    Proposal* p = nullptr;
+    if (!proposals_.empty() && !proposals_.front().finished &&
+        proposals_.front().instance_id == instance_id_) {
+      p = &proposals_.front();
+    }
+
     bool my = false;
-    if (is_proposing_) {
-      io_loop_->Remove(propose_timer_);
-      if (propose_value_.machine_id() == learned_value.machine_id() &&
-          propose_value_.user_data() == learned_value.user_data()) {
-        my = true;
-      }
+    if (p) {
+      my = (learned_value.node_id() == config_->GetNodeId() &&
+            learned_value.value_id() == p->value_id);
     }
 
-    bool success = MachineExecute(learned_value, my);
+    bool success = MachineExecute(learned_value, my ? p->context : nullptr);
 
-    if (is_proposing_) {
+    if (p) {
       Status status;
       if (success) {
         if (!my) {
@@ -177,21 +394,42 @@ void Instance::CheckLearn() {
                  learned_value.machine_id());
         status = Status::MachineError(msg);
       }
-      propose_cb_(instance_id_, status, context_);
-      is_proposing_ = false;
-      context_ = nullptr;
+      p->finished = true;
+      p->status = status;
+      FinishProposals();
+      if (proposals_.empty()) {
+        io_loop_->Remove(propose_timer_);
+      } else {
+        AddProposeTimer();
+      }
     }
 
+    // A failed execution is retried on the same instance, the promise of
+    // the acceptors is still held, so the proposer keeps skipping prepare.
     if (success) {
       NextInstance();
     } else {
-      proposer_.SetNoSkipPrepare();
+      break;
     }
   }
 }
 
-bool Instance::MachineExecute(const PaxosValue& value, bool my) {
-  void* context = my ? context_ : nullptr;
+// Nothing is being proposed, so the learned values when catching up can be
+// executed together without matching the proposals.
+bool Instance::ExecuteLearnedValues() {
+  std::vector<const PaxosValue*> values;
+  learner_.GetLearnedValues(&values);
+  if (values.size() < 2) {
+    return true;
+  }
+  size_t n = config_->GetMachineManager()->ExecuteBatch(instance_id_, values);
+  for (size_t i = 0; i < n; ++i) {
+    NextInstance();
+  }
+  return n == values.size();
+}
+
+bool Instance::MachineExecute(const PaxosValue& value, void* context) {
   return config_->GetMachineManager()->Execute(instance_id_, value, context);
 }
 
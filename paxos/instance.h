@@ -5,11 +5,14 @@
 #ifndef SKYWALKER_PAXOS_INSTANCE_H_
 #define SKYWALKER_PAXOS_INSTANCE_H_
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <string>
 
 #include "paxos/acceptor.h"
 #include "paxos/learner.h"
+#include "paxos/paxos_value.h"
 #include "paxos/proposer.h"
 #include "proto/paxos.pb.h"
 #include "skywalker/options.h"
@@ -38,16 +41,58 @@ class Instance {
   void SetIOLoop(RunLoop* loop);
   void SetLearnLoop(RunLoop* loop);
 
-  void OnPropose(uint32_t machine_id, const std::string& value,
+  // The value is moved into the proposal.
+  void OnPropose(uint32_t machine_id, std::string&& value,
                  void* context = nullptr);
-  void OnContent(const Content& c);
+  // The value is swapped into the proposal.
+  // If the value is a batch, the context is a BatchContext.
+  void OnProposeValue(PaxosValue* value, void* context);
+  // With a stable master, the proposals on the other nodes would break the
+  // ballot of the master, so they are refused and the callers retry on the
+  // master. It's checked in the loop, where the mastership is up to date.
+  bool RefusePropose(void* context);
+  // Finish the proposal without proposing, the callback will be called
+  // after the proposals in the propose window have finished.
+  void FinishPropose(const Status& status, void* context = nullptr);
+  void OnReadIndex(void* context, const ReadIndexCallback& cb);
+  // The value of an accept message is taken out of the content.
+  void OnContent(Content* c);
   void OnPaxosMessage(const PaxosMessage& msg);
+  // The accept message without its value, which is shared by the roles.
+  void OnPaxosMessage(const PaxosMessage& msg, const PaxosValuePtr& value);
   void OnCheckpointMessage(const CheckpointMessage& msg);
+  // The acceptor has made its states durable.
+  void OnAcceptorWritten();
+
+  // Go on from the instance after the loaded checkpoint.
+  void OnLoadCheckpoint(uint64_t instance_id);
 
  private:
+  struct Proposal {
+    uint64_t instance_id;
+    void* context;
+    uint64_t value_id;
+    bool finished;
+    Status status;
+  };
+
+  struct Read {
+    void* context;
+    ReadIndexCallback cb;
+    TimerId timer;
+  };
+
+  void OnAskForReadIndex(const PaxosMessage& msg);
+  void OnReadIndexReply(const PaxosMessage& msg);
+  void CheckReads();
+
   void CheckLearn();
-  bool MachineExecute(const PaxosValue& value, bool my);
+  bool ExecuteLearnedValues();
+  bool MachineExecute(const PaxosValue& value, void* context);
   void NextInstance();
+  void FinishProposals();
+  void FailProposals(const Status& status);
+  void AddProposeTimer();
 
   Config* config_;
   RunLoop* io_loop_;
@@ -58,12 +103,22 @@ class Instance {
 
   uint64_t instance_id_;
 
-  bool is_proposing_;
-  void* context_;
-  PaxosValue propose_value_;
+  // Marks the values proposed by this node, which starts from the time so
+  // that it doesn't repeat after restarting.
+  uint64_t value_id_;
+
+  // The proposals in the propose window, ordered by the instance_id.
+  std::deque<Proposal> proposals_;
   ProposeCompleteCallback propose_cb_;
   TimerId propose_timer_;
 
+  // The reads asking the master for the read index or waiting for this
+  // node to execute the instances before it, which are keyed by read_id.
+  uint64_t read_id_;
+  std::map<uint64_t, Read> reads_;
+  // read index -> read_id
+  std::multimap<uint64_t, uint64_t> waiting_reads_;
+
   // No copying allowed
   Instance(const Instance&);
   void operator=(const Instance&);
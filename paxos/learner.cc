@@ -15,7 +15,23 @@
 
 namespace skywalker {
 
-std::atomic<bool> Learner::is_sending_checkpoint_(false);
+namespace {
+
+// A catch-up message carries at most kStreamCount instances or about
+// kStreamBytes bytes, and at most kStreamCredits messages of a stream
+// can be waiting for the comfirmation.
+static const int kStreamCount = 256;
+static const size_t kStreamBytes = 1024 * 1024;
+static const size_t kStreamCredits = 4;
+
+// The receiver buffers the instances out of order within this range.
+static const uint64_t kMaxReceivedCount = kStreamCount * kStreamCredits * 2;
+
+// A stream without any comfirmation in this time goes back to the last
+// comfirmed instance, since a message or a comfirmation may be lost.
+static const uint64_t kStreamTimeout = 1000 * 1000;
+
+}  // namespace
 
 Learner::Learner(Config* config, Instance* instance, Acceptor* acceptor)
     : config_(config),
@@ -26,21 +42,43 @@ Learner::Learner(Config* config, Instance* instance, Acceptor* acceptor)
       rand_(static_cast<uint32_t>(NowMillis())),
       is_learning_(false),
       has_learned_(false),
-      is_receiving_checkponit_(false) {}
+      is_receiving_checkponit_(false),
+      is_sending_checkpoint_(false) {}
 
 void Learner::OnNewChosenValue(const PaxosMessage& msg) {
   if (msg.instance_id() == instance_id_) {
     const BallotNumber& b = acceptor_->GetAcceptedBallot();
     BallotNumber ballot(msg.proposal_id(), msg.node_id());
-    if (ballot == b) {
+    if (ballot == b && acceptor_->GetAcceptedValue()) {
       FinishLearnValue(acceptor_->GetAcceptedValue());
       BroadcastMessageToFollower(b);
     } else if (msg.has_value()) {
       if (WriteToDB(msg)) {
-        FinishLearnValue(msg.value());
+        FinishLearnValue(std::make_shared<PaxosValue>(msg.value()));
         BroadcastMessageToFollower(b);
       }
+    } else {
+      // The acceptor may be writing the accepted value, try it again
+      // after the write.
+      chosen_msgs_[msg.instance_id()] = msg;
     }
+  } else if (msg.instance_id() > instance_id_ &&
+             msg.instance_id() < instance_id_ + config_->ProposeWindow()) {
+    // Learn it after the previous instances have been learned.
+    chosen_msgs_[msg.instance_id()] = msg;
+  }
+}
+
+void Learner::CheckChosenValue() {
+  if (has_learned_) {
+    return;
+  }
+  auto it = chosen_msgs_.find(instance_id_);
+  if (it != chosen_msgs_.end()) {
+    PaxosMessage msg;
+    msg.Swap(&it->second);
+    chosen_msgs_.erase(it);
+    OnNewChosenValue(msg);
   }
 }
 
@@ -62,7 +100,10 @@ void Learner::AskForLearn(bool add_timer) {
 }
 
 void Learner::AddLearnTimer(uint64_t timeout) {
-  learn_timer_ = io_loop_->RunAfter(timeout, [this]() { AskForLearn(true); });
+  if (!io_loop_->Restart(learn_timer_, timeout)) {
+    learn_timer_ =
+        io_loop_->RunAfter(timeout, [this]() { AskForLearn(true); });
+  }
 }
 
 void Learner::RemoveLearnTimer() { io_loop_->Remove(learn_timer_); }
@@ -146,6 +187,7 @@ void Learner::ComfirmAskForLearn(const PaxosMessage& msg) {
   reply_msg->set_type(COMFIRM_ASK_FOR_LEARN);
   reply_msg->set_node_id(config_->GetNodeId());
   reply_msg->set_instance_id(instance_id_);
+  reply_msg->set_learn_stream(true);
   messager_->SendMessage(msg.node_id(), content);
 }
 
@@ -153,29 +195,25 @@ void Learner::OnComfirmAskForLearn(const PaxosMessage& msg) {
   uint64_t node_id = msg.node_id();
   uint64_t from = msg.instance_id();
   uint64_t to = instance_id_;
-  learn_loop_->QueueInLoop(
-      [node_id, from, to, this] { ASyncSend(node_id, from, to); });
+  if (msg.learn_stream()) {
+    learn_loop_->QueueInLoop(
+        [node_id, from, to, this] { StartStream(node_id, from, to); });
+  } else {
+    learn_loop_->QueueInLoop(
+        [node_id, from, to, this] { ASyncSend(node_id, from, to); });
+  }
 }
 
+// The old nodes drop the SEND_LEARNED_VALUES messages, so they are sent
+// the instances one by one.
 void Learner::ASyncSend(uint64_t node_id, uint64_t from, uint64_t to) {
-  Content content;
-  content.set_type(PAXOS_MESSAGE);
-  content.set_group_id(config_->GetGroupId());
-  PaxosMessage* msg = content.mutable_paxos_msg();
-  msg->set_type(SEND_LEARNED_VALUE);
-  msg->set_node_id(config_->GetNodeId());
-
+  PaxosInstance temp;
+  std::string s;
   while (from < to) {
-    std::string s;
     int ret = config_->GetDB()->Get(from, &s);
     if (ret == 0) {
-      PaxosInstance temp;
       temp.ParseFromString(s);
-      msg->set_instance_id(temp.instance_id());
-      msg->set_proposal_id(temp.accepted_id());
-      msg->set_proposal_node_id(temp.accepted_node_id());
-      msg->set_allocated_value(temp.release_accepted_value());
-      messager_->SendMessage(node_id, content);
+      SendLearnedValue(node_id, temp);
       ++from;
     } else {
       LOG_ERROR("Group %u - no found data of instance %llu",
@@ -185,6 +223,122 @@ void Learner::ASyncSend(uint64_t node_id, uint64_t from, uint64_t to) {
   }
 }
 
+void Learner::OnComfirmLearnedValues(const PaxosMessage& msg) {
+  uint64_t node_id = msg.node_id();
+  uint64_t comfirmed = msg.instance_id();
+  uint64_t to = instance_id_;
+  learn_loop_->QueueInLoop([node_id, comfirmed, to, this] {
+    UpdateStream(node_id, comfirmed, to);
+  });
+}
+
+void Learner::StartStream(uint64_t node_id, uint64_t from, uint64_t to) {
+  // A new asking replaces the old stream, whose receiver may have restarted.
+  Stream& s = streams_[node_id];
+  s.next = from;
+  s.to = to;
+  s.comfirmed = from;
+  s.ends.clear();
+  SendStream(node_id, &s);
+  CheckStream(node_id);
+}
+
+void Learner::UpdateStream(uint64_t node_id, uint64_t comfirmed,
+                           uint64_t to) {
+  auto it = streams_.find(node_id);
+  if (it == streams_.end()) {
+    return;
+  }
+  Stream& s = it->second;
+  while (!s.ends.empty() && s.ends.front() <= comfirmed) {
+    s.ends.pop_front();
+  }
+  if (comfirmed > s.comfirmed) {
+    s.comfirmed = comfirmed;
+  }
+  if (comfirmed > s.next) {
+    s.next = comfirmed;
+  }
+  // Keep sending the instances chosen while catching up.
+  if (to > s.to) {
+    s.to = to;
+  }
+  SendStream(node_id, &s);
+  CheckStream(node_id);
+}
+
+// The stream is finished when nothing is waiting for the comfirmation,
+// otherwise its timer is restarted.
+void Learner::CheckStream(uint64_t node_id) {
+  auto it = streams_.find(node_id);
+  if (it == streams_.end()) {
+    return;
+  }
+  Stream& s = it->second;
+  if (s.ends.empty()) {
+    learn_loop_->Remove(s.timer);
+    streams_.erase(it);
+  } else if (!learn_loop_->Restart(s.timer, kStreamTimeout)) {
+    s.timer = learn_loop_->RunAfter(
+        kStreamTimeout, [this, node_id]() { OnStreamTimeout(node_id); });
+  }
+}
+
+void Learner::OnStreamTimeout(uint64_t node_id) {
+  auto it = streams_.find(node_id);
+  if (it == streams_.end()) {
+    return;
+  }
+  Stream& s = it->second;
+  s.timer = TimerId();
+  LOG_WARN("Group %u - the stream to node %llu times out, resend from %llu.",
+           config_->GetGroupId(), (unsigned long long)node_id,
+           (unsigned long long)s.comfirmed);
+  s.next = s.comfirmed;
+  s.ends.clear();
+  SendStream(node_id, &s);
+  CheckStream(node_id);
+}
+
+void Learner::SendStream(uint64_t node_id, Stream* s) {
+  std::unique_ptr<LogIterator> iter;
+  while (s->ends.size() < kStreamCredits && s->next < s->to) {
+    if (!iter) {
+      iter.reset(config_->GetDB()->NewIterator());
+      iter->Seek(s->next);
+    }
+
+    Content content;
+    content.set_type(PAXOS_MESSAGE);
+    content.set_group_id(config_->GetGroupId());
+    PaxosMessage* msg = content.mutable_paxos_msg();
+    msg->set_type(SEND_LEARNED_VALUES);
+    msg->set_node_id(config_->GetNodeId());
+
+    size_t bytes = 0;
+    while (s->next < s->to && msg->accepted_instances_size() < kStreamCount &&
+           bytes < kStreamBytes) {
+      if (!iter->Valid() || iter->key() != s->next) {
+        LOG_ERROR("Group %u - no found data of instance %llu",
+                  config_->GetGroupId(), (unsigned long long)s->next);
+        s->to = s->next;
+        break;
+      }
+      Slice v(iter->value());
+      msg->add_accepted_instances()->ParseFromArray(v.data(),
+                                                    static_cast<int>(v.size()));
+      bytes += v.size();
+      iter->Next();
+      ++s->next;
+    }
+    if (msg->accepted_instances_size() == 0) {
+      break;
+    }
+    messager_->SendMessage(node_id, content);
+    s->ends.push_back(s->next);
+  }
+}
+
 void Learner::SendLearnedValue(uint64_t node_id, const PaxosInstance& p) {
   Content content;
   content.set_type(PAXOS_MESSAGE);
@@ -202,13 +356,106 @@ void Learner::SendLearnedValue(uint64_t node_id, const PaxosInstance& p) {
 void Learner::OnSendLearnedValue(const PaxosMessage& msg) {
   if (msg.instance_id() == instance_id_) {
     if (WriteToDB(msg)) {
-      FinishLearnValue(msg.value());
+      FinishLearnValue(std::make_shared<PaxosValue>(msg.value()));
       BallotNumber b(msg.proposal_id(), msg.node_id());
       BroadcastMessageToFollower(b);
     }
   }
 }
 
+void Learner::OnSendLearnedValues(const PaxosMessage& msg) {
+  for (auto& p : msg.accepted_instances()) {
+    uint64_t id = p.instance_id();
+    if (id >= instance_id_ && id < instance_id_ + kMaxReceivedCount &&
+        learned_instances_.find(id) == learned_instances_.end()) {
+      received_instances_[id] = p;
+    }
+  }
+
+  uint64_t next = instance_id_;
+  if (!learned_instances_.empty()) {
+    next = learned_instances_.rbegin()->first + 1;
+  } else if (has_learned_) {
+    ++next;
+  }
+  if (WriteToDB(&next) == 0 && !has_learned_) {
+    LearnInstance(instance_id_);
+  }
+  ComfirmLearnedValues(msg.node_id(), next);
+}
+
+// Write the received instances which follow next in one batch,
+// and store the end of them in *next.
+int Learner::WriteToDB(uint64_t* next) {
+  auto it = received_instances_.begin();
+  while (it != received_instances_.end() && it->first < *next) {
+    it = received_instances_.erase(it);
+  }
+
+  WriteBatch batch;
+  uint64_t end = *next;
+  std::string s;
+  for (; it != received_instances_.end() && it->first == end; ++it, ++end) {
+    PaxosInstance& p = it->second;
+    SetPromise(&p);
+    p.SerializeToString(&s);
+    batch.Put(end, s);
+  }
+  if (batch.Count() == 0) {
+    return 0;
+  }
+  config_->GetDB()->SetMaxChosenInstanceId(end - 1, &batch);
+
+  WriteOptions options;
+  options.sync = false;
+  int res = config_->GetDB()->WriteChosen(options, &batch, end);
+  if (res != 0) {
+    LOG_ERROR("Group %u - write the learned instances failed.",
+              config_->GetGroupId());
+    return res;
+  }
+  for (; *next < end; ++*next) {
+    auto i = received_instances_.find(*next);
+    learned_instances_[*next].Swap(&i->second);
+    received_instances_.erase(i);
+  }
+  return 0;
+}
+
+bool Learner::LearnInstance(uint64_t instance_id) {
+  auto it = learned_instances_.find(instance_id);
+  if (it == learned_instances_.end()) {
+    return false;
+  }
+  PaxosInstance p;
+  p.Swap(&it->second);
+  learned_instances_.erase(it);
+  FinishLearnValue(NewPaxosValue(p.mutable_accepted_value()));
+  BroadcastMessageToFollower(
+      BallotNumber(p.accepted_id(), p.accepted_node_id()));
+  return true;
+}
+
+void Learner::GetLearnedValues(std::vector<const PaxosValue*>* values) const {
+  values->push_back(learned_value_.get());
+  uint64_t id = instance_id_ + 1;
+  for (auto it = learned_instances_.find(id);
+       it != learned_instances_.end() && it->first == id; ++it, ++id) {
+    values->push_back(&it->second.accepted_value());
+  }
+}
+
+void Learner::ComfirmLearnedValues(uint64_t node_id, uint64_t next) {
+  Content content;
+  content.set_type(PAXOS_MESSAGE);
+  content.set_group_id(config_->GetGroupId());
+  PaxosMessage* msg = content.mutable_paxos_msg();
+  msg->set_type(COMFIRM_LEARNED_VALUES);
+  msg->set_node_id(config_->GetNodeId());
+  msg->set_instance_id(next);
+  messager_->SendMessage(node_id, content);
+}
+
 void Learner::AskForCheckpoint(const PaxosMessage& msg) {
   Content content;
   content.set_type(PAXOS_MESSAGE);
@@ -222,7 +469,7 @@ void Learner::AskForCheckpoint(const PaxosMessage& msg) {
 
 void Learner::OnAskForCheckpoint(const PaxosMessage& msg) {
   uint64_t node_id = msg.node_id();
-  learn_loop_->QueueInLoop([this, node_id] {
+  config_->GetCheckpointManager()->SendLoop()->QueueInLoop([this, node_id] {
     is_sending_checkpoint_ = true;
     SendCheckpoint(node_id);
     is_sending_checkpoint_ = false;
@@ -235,36 +482,55 @@ void Learner::SendCheckpoint(uint64_t node_id) {
 
 void Learner::OnSendCheckpoint(const CheckpointMessage& msg) {
   bool success = config_->GetCheckpointManager()->ReceiveCheckpoint(msg);
+  uint64_t instance_id;
+  if (success &&
+      config_->GetCheckpointManager()->HasLoadedCheckpoint(&instance_id)) {
+    instance_->OnLoadCheckpoint(instance_id);
+    return;
+  }
   uint64_t timeout = success ? 120 * 1000 * 1000 : 1000;
-  RemoveLearnTimer();
   AddLearnTimer(timeout);
 }
 
 bool Learner::WriteToDB(const PaxosMessage& msg) {
   PaxosInstance temp;
   temp.set_instance_id(msg.instance_id());
-  temp.set_promised_id(msg.proposal_id());
-  temp.set_promised_node_id(msg.node_id());
   temp.set_accepted_id(msg.proposal_id());
   temp.set_accepted_node_id(msg.node_id());
   *(temp.mutable_accepted_value()) = msg.value();
+  SetPromise(&temp);
+
+  WriteBatch batch;
+  batch.Put(msg.instance_id(), temp.SerializeAsString());
+  config_->GetDB()->SetMaxChosenInstanceId(msg.instance_id(), &batch);
 
   WriteOptions options;
   options.sync = false;
-
-  int res = config_->GetDB()->Put(options, msg.instance_id(),
-                                  temp.SerializeAsString());
+  int res = config_->GetDB()->WriteChosen(options, &batch,
+                                          msg.instance_id() + 1);
   return res == 0;
 }
 
-void Learner::FinishLearnValue(const PaxosValue& value) {
+// The acceptor recovers its promise from the records, so a learned record
+// keeps the promise of the acceptor if it's higher than the accepted one.
+void Learner::SetPromise(PaxosInstance* p) const {
+  BallotNumber b(p->accepted_id(), p->accepted_node_id());
+  const BallotNumber& promised = acceptor_->GetMaxPromisedBallot();
+  if (promised > b) {
+    b = promised;
+  }
+  p->set_promised_id(b.GetProposalId());
+  p->set_promised_node_id(b.GetNodeId());
+}
+
+void Learner::FinishLearnValue(const PaxosValuePtr& value) {
   learned_value_ = value;
   has_learned_ = true;
   LOG_INFO("Group %u - learn a new value.", config_->GetGroupId());
 }
 
 void Learner::BroadcastMessageToFollower(const BallotNumber& ballot) {
-  if (config_->GetFollowers()->members().size() > 0) {
+  if (config_->GetFollowers()->size() > 0) {
     Content content;
     content.set_type(PAXOS_MESSAGE);
     content.set_group_id(config_->GetGroupId());
@@ -274,16 +540,45 @@ void Learner::BroadcastMessageToFollower(const BallotNumber& ballot) {
     msg->set_instance_id(instance_id_);
     msg->set_proposal_id(ballot.GetProposalId());
     msg->set_proposal_node_id(ballot.GetNodeId());
-    *(msg->mutable_value()) = learned_value_;
+    *(msg->mutable_value()) = *learned_value_;
     messager_->BroadcastMessageToFollower(content);
   }
 }
 
+void Learner::SkipTo(uint64_t instance_id) {
+  instance_id_ = instance_id;
+  has_learned_ = false;
+  learned_value_.reset();
+  chosen_msgs_.clear();
+  received_instances_.clear();
+  learned_instances_.clear();
+  RemoveLearnTimer();
+  AskForLearn(true);
+}
+
 void Learner::NextInstance() {
   config_->GetLogManager()->SetMaxChosenInstanceId(instance_id_);
   has_learned_ = false;
-  learned_value_.Clear();
+  learned_value_.reset();
   ++instance_id_;
+
+  while (!chosen_msgs_.empty() && chosen_msgs_.begin()->first < instance_id_) {
+    chosen_msgs_.erase(chosen_msgs_.begin());
+  }
+  while (!learned_instances_.empty() &&
+         learned_instances_.begin()->first < instance_id_) {
+    learned_instances_.erase(learned_instances_.begin());
+  }
+  if (LearnInstance(instance_id_)) {
+    return;
+  }
+  auto it = chosen_msgs_.find(instance_id_);
+  if (it != chosen_msgs_.end()) {
+    PaxosMessage msg;
+    msg.Swap(&it->second);
+    chosen_msgs_.erase(it);
+    OnNewChosenValue(msg);
+  }
 }
 
 }  // namespace skywalker
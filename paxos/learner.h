@@ -6,8 +6,12 @@
 #define SKYWALKER_PAXOS_LEARNER_H_
 
 #include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
 
 #include "paxos/ballot_number.h"
+#include "paxos/paxos_value.h"
 #include "proto/paxos.pb.h"
 #include "util/random.h"
 #include "util/runloop.h"
@@ -37,13 +41,23 @@ class Learner {
   void OnSendNowInstanceId(const PaxosMessage& msg);
   void OnComfirmAskForLearn(const PaxosMessage& msg);
   void OnSendLearnedValue(const PaxosMessage& msg);
+  void OnSendLearnedValues(const PaxosMessage& msg);
+  void OnComfirmLearnedValues(const PaxosMessage& msg);
   void OnAskForCheckpoint(const PaxosMessage& msg);
   void OnSendCheckpoint(const CheckpointMessage& msg);
 
+  // Learn the chosen value which is waiting for the acceptor.
+  void CheckChosenValue();
+
   bool HasLearned() const { return has_learned_; }
-  const PaxosValue& GetLearnedValue() const { return learned_value_; }
+  const PaxosValue& GetLearnedValue() const { return *learned_value_; }
+
+  // Store the learned value and the values of the written instances
+  // following it in *values, which can be executed together.
+  void GetLearnedValues(std::vector<const PaxosValue*>* values) const;
 
   void NextInstance();
+  void SkipTo(uint64_t instance_id);
 
  private:
   void AddLearnTimer(uint64_t timeout);
@@ -51,14 +65,36 @@ class Learner {
 
   void SendNowInstanceId(const PaxosMessage& msg);
   void ComfirmAskForLearn(const PaxosMessage& msg);
-  void ASyncSend(uint64_t node_id, uint64_t from, uint64_t to);
   void SendLearnedValue(uint64_t node_id, const PaxosInstance& p);
 
+  // The catch-up stream to a lagging node, which is used in the learn loop.
+  struct Stream {
+    uint64_t next;
+    uint64_t to;
+    // The receiver has written the instances before it.
+    uint64_t comfirmed;
+    // The end instance_id of the messages which haven't been comfirmed,
+    // every message takes a credit.
+    std::deque<uint64_t> ends;
+    TimerId timer;
+  };
+
+  void ASyncSend(uint64_t node_id, uint64_t from, uint64_t to);
+  void StartStream(uint64_t node_id, uint64_t from, uint64_t to);
+  void UpdateStream(uint64_t node_id, uint64_t comfirmed, uint64_t to);
+  void SendStream(uint64_t node_id, Stream* s);
+  void CheckStream(uint64_t node_id);
+  void OnStreamTimeout(uint64_t node_id);
+  void ComfirmLearnedValues(uint64_t node_id, uint64_t next);
+  bool LearnInstance(uint64_t instance_id);
+
   void AskForCheckpoint(const PaxosMessage& msg);
   void SendCheckpoint(uint64_t node_id);
 
   bool WriteToDB(const PaxosMessage& msg);
-  void FinishLearnValue(const PaxosValue& value);
+  int WriteToDB(uint64_t* next);
+  void SetPromise(PaxosInstance* p) const;
+  void FinishLearnValue(const PaxosValuePtr& value);
   void BroadcastMessageToFollower(const BallotNumber& ballot);
 
   Config* config_;
@@ -75,11 +111,21 @@ class Learner {
   Random rand_;
   bool is_learning_;
   bool has_learned_;
-  PaxosValue learned_value_;
+  PaxosValuePtr learned_value_;
+
+  // The chosen messages of the later instances in the propose window.
+  std::map<uint64_t, PaxosMessage> chosen_msgs_;
+
+  // The instances from the catch-up streams, which have been received out
+  // of order, or have been written but not executed.
+  std::map<uint64_t, PaxosInstance> received_instances_;
+  std::map<uint64_t, PaxosInstance> learned_instances_;
+
+  std::map<uint64_t, Stream> streams_;
 
   bool is_receiving_checkponit_;
 
-  static std::atomic<bool> is_sending_checkpoint_;
+  std::atomic<bool> is_sending_checkpoint_;
 
   // No copying allowed
   Learner(const Learner&);
@@ -5,35 +5,131 @@
 #include "paxos/node_impl.h"
 
 #include <algorithm>
+#include <atomic>
+#include <map>
 #include <random>
+#include <set>
+#include <string>
+#include <thread>
 #include <utility>
 
+#include "machine/membership_view.h"
 #include "proto/paxos.pb.h"
+#include "skywalker/file.h"
 #include "skywalker/logging.h"
+#include "util/thread.h"
 
 namespace skywalker {
 
+namespace {
+
+struct RecoverContext {
+  std::vector<Group*>* groups;
+  std::atomic<size_t> next;
+  std::atomic<bool> failed;
+};
+
+void* RecoverGroups(void* arg) {
+  RecoverContext* ctx = reinterpret_cast<RecoverContext*>(arg);
+  size_t i;
+  while (!ctx->failed && (i = ctx->next++) < ctx->groups->size()) {
+    if ((*ctx->groups)[i]->Recover()) {
+      LOG_DEBUG("Group %u recover successful!", static_cast<uint32_t>(i));
+    } else {
+      LOG_DEBUG("Group %u recover failed!", static_cast<uint32_t>(i));
+      ctx->failed = true;
+    }
+  }
+  return nullptr;
+}
+
+// The quorums which don't fit the members would quietly fall back to the
+// majority, so they are refused when the group is configured.
+bool CheckQuorums(uint32_t group_id, const GroupOptions& options) {
+  if (options.phase1_quorum == 0 && options.phase2_quorum == 0) {
+    return true;
+  }
+  std::set<uint64_t> ids;
+  for (auto& m : options.membership) {
+    ids.insert(m.id);
+  }
+  if (!ids.empty() && !MembershipView::IsValid(ids.size(),
+                                               options.phase1_quorum,
+                                               options.phase2_quorum)) {
+    LOG_ERROR("Group %u - phase1_quorum=%u and phase2_quorum=%u don't fit "
+              "%llu members.",
+              group_id, options.phase1_quorum, options.phase2_quorum,
+              (unsigned long long)ids.size());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 NodeImpl::NodeImpl(const Options& options)
-    : stop_(false), options_(options), network_(options.my) {}
+    : stop_(false), options_(options), network_(options) {}
 
 NodeImpl::~NodeImpl() { stop_ = true; }
 
 bool NodeImpl::StartWorking() {
   std::vector<Group*> groups;
-  int i = 0;
+  uint32_t i = 0;
   for (auto& g : options_.groups) {
-    std::unique_ptr<Group> group(new Group(options_.my.id, i, g, &network_));
-    if (group->Recover()) {
-      LOG_DEBUG("Group %u recover successful!", i);
-      groups.push_back(group.get());
-      groups_.push_back(std::move(group));
-    } else {
-      LOG_DEBUG("Group %u recover failed!", i);
+    if (!CheckQuorums(i, g)) {
       return false;
     }
+    std::unique_ptr<Group> group(new Group(options_.my.id, i, g, &network_));
+    groups.push_back(group.get());
+    groups_.push_back(std::move(group));
     ++i;
   }
 
+  // The shared log is replayed by the groups when they recover.
+  std::string commit_path = options_.group_commit_path;
+  if (commit_path.empty() && !options_.groups.empty()) {
+    commit_path = options_.groups[0].log_storage_path + "/group_commit";
+  }
+  if (options_.group_commit ||
+      FileManager::Instance()->FileExists(commit_path)) {
+    group_commit_.reset(new GroupCommit(options_.group_commit_time));
+    if (group_commit_->Open(commit_path) != 0) {
+      LOG_ERROR("The log of group commit(%s) open failed.",
+                commit_path.c_str());
+      return false;
+    }
+    for (auto& g : groups) {
+      g->SetGroupCommit(group_commit_.get());
+    }
+  }
+
+  if (options_.recover_thread_size == 0) {
+    options_.recover_thread_size = std::thread::hardware_concurrency();
+  }
+  if (options_.recover_thread_size == 0) {
+    options_.recover_thread_size = 1;
+  } else if (options_.recover_thread_size > groups.size()) {
+    options_.recover_thread_size = static_cast<uint32_t>(groups.size());
+  }
+
+  RecoverContext ctx;
+  ctx.groups = &groups;
+  ctx.next = 0;
+  ctx.failed = false;
+  {
+    std::vector<std::unique_ptr<Thread>> threads;
+    for (uint32_t j = 0; j < options_.recover_thread_size; ++j) {
+      threads.push_back(std::unique_ptr<Thread>(new Thread()));
+      threads.back()->Start(&RecoverGroups, &ctx);
+    }
+    for (auto& t : threads) {
+      t->Join();
+    }
+  }
+  if (ctx.failed) {
+    return false;
+  }
+
   if (options_.io_thread_size == 0) {
     options_.io_thread_size = static_cast<uint32_t>((groups.size() + 1) / 2);
   } else if (options_.io_thread_size > groups.size()) {
@@ -50,10 +146,24 @@ bool NodeImpl::StartWorking() {
   assert(options_.callback_thread_size != 0);
   pool_.Start(options_.io_thread_size, options_.callback_thread_size);
 
+  if (group_commit_) {
+    if (group_commit_->EndReplay() != 0) {
+      return false;
+    }
+    if (options_.group_commit) {
+      group_commit_->Start();
+    } else {
+      for (auto& g : groups) {
+        g->SetGroupCommit(nullptr);
+      }
+      group_commit_.reset();
+    }
+  }
+
   for (auto& g : groups) {
     g->SetNewMembershipCallback(options_.membership_cb);
     g->SetNewMasterCallback(options_.master_cb);
-    g->Start(pool_.GetNextIOLoop(), pool_.GetNextCallbackLoop());
+    g->Start(pool_.NewIOLoop(), pool_.GetNextCallbackLoop());
     g->StartGC();
   }
 
@@ -87,15 +197,34 @@ bool NodeImpl::Propose(uint32_t group_id, uint32_t machine_id,
                                       std::move(cb));
 }
 
-void NodeImpl::OnContent(std::unique_ptr<Content> c) {
+bool NodeImpl::Propose(uint32_t group_id, uint32_t machine_id,
+                       std::string&& value, void* context,
+                       ProposeCompleteCallback&& cb) {
+  return groups_[group_id]->OnPropose(machine_id, std::move(value), context,
+                                      std::move(cb));
+}
+
+bool NodeImpl::ReadIndex(uint32_t group_id, void* context,
+                         const ReadIndexCallback& cb) {
+  return groups_[group_id]->ReadIndex(context, cb);
+}
+
+void NodeImpl::OnContent(Contents* contents) {
   // FIXME
   // Maybe use a mutex?
   if (!stop_) {
-    uint32_t group_id = c->group_id();
-    if (group_id < groups_.size()) {
-      groups_[group_id]->OnContent(std::move(c));
-    } else {
-      LOG_DEBUG("Receive an invalid content, group_id=%u is invalid", group_id);
+    std::map<uint32_t, Contents> batches;
+    for (auto& c : *contents) {
+      uint32_t group_id = c->group_id();
+      if (group_id < groups_.size()) {
+        batches[group_id].push_back(std::move(c));
+      } else {
+        LOG_DEBUG("Receive an invalid content, group_id=%u is invalid",
+                  group_id);
+      }
+    }
+    for (auto& b : batches) {
+      groups_[b.first]->OnContent(&b.second);
     }
   }
 }
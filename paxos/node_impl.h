@@ -16,6 +16,7 @@
 #include "proto/paxos.pb.h"
 #include "skywalker/node.h"
 #include "skywalker/options.h"
+#include "storage/group_commit.h"
 
 namespace skywalker {
 
@@ -36,6 +37,13 @@ class NodeImpl : public Node {
                        const std::string& value, void* context,
                        ProposeCompleteCallback&& cb);
 
+  virtual bool Propose(uint32_t group_id, uint32_t machine_id,
+                       std::string&& value, void* context,
+                       ProposeCompleteCallback&& cb);
+
+  virtual bool ReadIndex(uint32_t group_id, void* context,
+                         const ReadIndexCallback& cb);
+
   virtual bool ChangeMember(uint32_t group_id,
                             const std::vector<std::pair<Member, bool>>& value,
                             void* context, const ProposeCompleteCallback& cb);
@@ -51,12 +59,13 @@ class NodeImpl : public Node {
   virtual void StopGC(uint32_t group_id);
 
  private:
-  void OnContent(std::unique_ptr<Content> c);
+  void OnContent(Contents* contents);
 
   bool stop_;
   Options options_;
   Network network_;
   ThreadPool pool_;
+  std::unique_ptr<GroupCommit> group_commit_;
   std::vector<std::unique_ptr<Group>> groups_;
 
   // No copying allowed
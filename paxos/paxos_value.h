@@ -0,0 +1,60 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_PAXOS_PAXOS_VALUE_H_
+#define SKYWALKER_PAXOS_PAXOS_VALUE_H_
+
+#include <memory>
+
+#include "proto/paxos.pb.h"
+
+namespace skywalker {
+
+// A value is held once and shared by the proposer, the acceptor and the
+// learner of an instance, it mustn't be changed after being shared.
+typedef std::shared_ptr<const PaxosValue> PaxosValuePtr;
+
+// Takes the value out of *value without copying it.
+inline PaxosValuePtr NewPaxosValue(PaxosValue* value) {
+  PaxosValue* v = new PaxosValue();
+  v->Swap(value);
+  return PaxosValuePtr(v);
+}
+
+// Lends the shared value to a message which is serialized or handled at
+// once, and takes it back before the message is destroyed, so the value
+// isn't copied into the message.
+class ValueLender {
+ public:
+  ValueLender(PaxosMessage* msg, const PaxosValuePtr& value)
+      : msg_(msg), instance_(nullptr) {
+    msg_->set_allocated_value(const_cast<PaxosValue*>(value.get()));
+  }
+
+  ValueLender(PaxosInstance* instance, const PaxosValuePtr& value)
+      : msg_(nullptr), instance_(instance) {
+    instance_->set_allocated_accepted_value(
+        const_cast<PaxosValue*>(value.get()));
+  }
+
+  ~ValueLender() {
+    if (msg_ != nullptr) {
+      msg_->release_value();
+    } else {
+      instance_->release_accepted_value();
+    }
+  }
+
+ private:
+  PaxosMessage* msg_;
+  PaxosInstance* instance_;
+
+  // No copying allowed
+  ValueLender(const ValueLender&);
+  void operator=(const ValueLender&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_PAXOS_PAXOS_VALUE_H_
@@ -0,0 +1,136 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "paxos/propose_batcher.h"
+
+#include <assert.h>
+#include <utility>
+
+#include "paxos/instance.h"
+#include "skywalker/logging.h"
+#include "util/mutexlock.h"
+
+namespace skywalker {
+
+ProposeBatcher::ProposeBatcher(Instance* instance, ProposeQueue* queue,
+                               size_t window, size_t count, size_t bytes)
+    : instance_(instance),
+      queue_(queue),
+      window_(window > 0 ? window : 1),
+      count_(count > 0 ? count : 1),
+      bytes_(bytes),
+      mutex_(),
+      running_(0),
+      pending_(nullptr) {}
+
+ProposeBatcher::~ProposeBatcher() { delete pending_; }
+
+bool ProposeBatcher::Put(ProposeRequest* r) {
+  bool res;
+  {
+    MutexLock lock(&mutex_);
+    Batch* batch = Add(r);
+    res = Commit(batch);
+  }
+  queue_->ReleaseRequest(r);
+  return res;
+}
+
+// The value and the callback are moved from the request into the batch.
+ProposeBatcher::Batch* ProposeBatcher::Add(ProposeRequest* r) {
+  if (pending_ == nullptr) {
+    pending_ = new Batch();
+  }
+  PaxosValue* v = pending_->value.add_values();
+  v->set_machine_id(r->machine_id);
+  pending_->bytes += r->value.size();
+  v->mutable_user_data()->swap(r->value);
+  pending_->context.contexts.push_back(r->context);
+  pending_->context.results.push_back(false);
+  pending_->callbacks.push_back(std::move(r->cb));
+  return pending_;
+}
+
+bool ProposeBatcher::Commit(Batch* batch) {
+  bool full = (batch->callbacks.size() >= count_ ||
+               (bytes_ != 0 && batch->bytes >= bytes_));
+  if (full || running_ < window_) {
+    if (!Flush()) {
+      // Take back the last value, so the caller can know it is rejected.
+      batch->bytes -= batch->value.values(batch->value.values_size() - 1)
+                          .user_data()
+                          .size();
+      batch->value.mutable_values()->RemoveLast();
+      batch->context.contexts.pop_back();
+      batch->context.results.pop_back();
+      batch->callbacks.pop_back();
+      if (batch->callbacks.empty()) {
+        delete pending_;
+        pending_ = nullptr;
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ProposeBatcher::Flush() {
+  assert(pending_ != nullptr);
+  Batch* batch = pending_;
+  ProposeHandler f;
+  if (batch->callbacks.size() == 1) {
+    // Only one value, propose it directly.
+    f = [this, batch]() {
+      if (!instance_->RefusePropose(batch->context.contexts[0])) {
+        instance_->OnProposeValue(batch->value.mutable_values(0),
+                                  batch->context.contexts[0]);
+      }
+    };
+  } else {
+    batch->value.set_batch(true);
+    f = [this, batch]() {
+      if (!instance_->RefusePropose(&batch->context)) {
+        instance_->OnProposeValue(&batch->value, &batch->context);
+      }
+    };
+  }
+  ProposeCompleteCallback cb = [this, batch](uint64_t instance_id,
+                                             const Status& s, void* context) {
+    BatchComplete(batch, instance_id, s, context);
+  };
+  if (!queue_->Put(std::move(f), std::move(cb))) {
+    return false;
+  }
+  pending_ = nullptr;
+  ++running_;
+  return true;
+}
+
+void ProposeBatcher::BatchComplete(Batch* batch, uint64_t instance_id,
+                                   const Status& s, void* context) {
+  if (batch->callbacks.size() == 1) {
+    batch->callbacks[0](instance_id, s, context);
+  } else {
+    for (size_t i = 0; i < batch->callbacks.size(); ++i) {
+      if (s.IsMachineError() && batch->context.results[i]) {
+        batch->callbacks[i](instance_id, Status::OK(),
+                            batch->context.contexts[i]);
+      } else {
+        batch->callbacks[i](instance_id, s, batch->context.contexts[i]);
+      }
+    }
+  }
+  delete batch;
+
+  MutexLock lock(&mutex_);
+  assert(running_ > 0);
+  --running_;
+  if (pending_ != nullptr && running_ < window_) {
+    if (!Flush()) {
+      LOG_WARN("Too many batches are waiting to be proposed!");
+    }
+  }
+}
+
+}  // namespace skywalker
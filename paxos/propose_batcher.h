@@ -0,0 +1,69 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_PAXOS_PROPOSE_BATCHER_H_
+#define SKYWALKER_PAXOS_PROPOSE_BATCHER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "machine/machine_manager.h"
+#include "paxos/propose_queue.h"
+#include "proto/paxos.pb.h"
+#include "skywalker/state_machine.h"
+#include "skywalker/status.h"
+#include "util/mutex.h"
+
+namespace skywalker {
+
+class Instance;
+
+// Packs the values proposed while the propose window is full into one
+// batched value, which is proposed on one instance. A value is proposed at
+// once when the window has room, otherwise it waits in the pending batch,
+// which is flushed when the window has room again or when it reaches
+// batch_count values or batch_bytes bytes.
+class ProposeBatcher {
+ public:
+  ProposeBatcher(Instance* instance, ProposeQueue* queue, size_t window,
+                 size_t count, size_t bytes);
+  ~ProposeBatcher();
+
+  // The request is always released.
+  bool Put(ProposeRequest* r);
+
+ private:
+  struct Batch {
+    Batch() : bytes(0) {}
+    PaxosValue value;
+    BatchContext context;
+    std::vector<ProposeCompleteCallback> callbacks;
+    size_t bytes;
+  };
+
+  Batch* Add(ProposeRequest* r);
+  bool Commit(Batch* batch);
+  bool Flush();
+  void BatchComplete(Batch* batch, uint64_t instance_id, const Status& s,
+                     void* context);
+
+  Instance* instance_;
+  ProposeQueue* queue_;
+  const size_t window_;
+  const size_t count_;
+  const size_t bytes_;
+
+  Mutex mutex_;
+  size_t running_;
+  Batch* pending_;
+
+  // No copying allowed
+  ProposeBatcher(const ProposeBatcher&);
+  void operator=(const ProposeBatcher&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_PAXOS_PROPOSE_BATCHER_H_
@@ -4,6 +4,7 @@
 
 #include "paxos/propose_queue.h"
 
+#include <assert.h>
 #include <utility>
 
 #include "skywalker/logging.h"
@@ -11,96 +12,135 @@
 
 namespace skywalker {
 
-ProposeQueue::ProposeQueue(size_t capacity)
-    : capacity_(capacity), mutex_(), last_finished_(true) {}
+ProposeQueue::ProposeQueue(size_t capacity, size_t window)
+    : capacity_(capacity),
+      window_(window > 0 ? window : 1),
+      io_loop_(nullptr),
+      callback_loop_(nullptr),
+      mutex_(),
+      running_(0) {}
 
-ProposeQueue::~ProposeQueue() {}
-
-bool ProposeQueue::CheckCapacity() const {
-  if (capacity_ != 0 && propose_queue_.size() > capacity_) {
-    LOG_WARN("Too many proposals are waiting to be proposed!");
-    return false;
+ProposeQueue::~ProposeQueue() {
+  // The callbacks which have been queued give their requests back,
+  // so wait for them before the requests are deleted.
+  if (callback_loop_ != nullptr && !callback_loop_->IsInMyLoop()) {
+    Mutex mutex;
+    Condition cond(&mutex);
+    bool done = false;
+    callback_loop_->QueueInLoop([&mutex, &cond, &done]() {
+      MutexLock lock(&mutex);
+      done = true;
+      cond.Signal();
+    });
+    MutexLock lock(&mutex);
+    while (!done) {
+      cond.Wait();
+    }
+  }
+  while (!requests_.empty()) {
+    delete requests_.front();
+    requests_.pop();
+  }
+  for (auto r : free_requests_) {
+    delete r;
   }
-  return true;
 }
 
-bool ProposeQueue::Put(const ProposeHandler& f,
-                       const ProposeCompleteCallback& cb) {
-  MutexLock lock(&mutex_);
-  if (last_finished_) {
-    last_finished_ = false;
-    io_loop_->QueueInLoop(f);
-  } else {
-    if (!CheckCapacity()) {
-      return false;
+ProposeRequest* ProposeQueue::NewRequest() {
+  {
+    MutexLock lock(&mutex_);
+    if (!free_requests_.empty()) {
+      ProposeRequest* r = free_requests_.back();
+      free_requests_.pop_back();
+      return r;
     }
-    propose_queue_.push(f);
   }
-  cb_queue_.push(cb);
-  return true;
+  return new ProposeRequest();
 }
 
-bool ProposeQueue::Put(ProposeHandler&& f, const ProposeCompleteCallback& cb) {
-  MutexLock lock(&mutex_);
-  if (last_finished_) {
-    last_finished_ = false;
-    io_loop_->QueueInLoop(std::move(f));
-  } else {
-    if (!CheckCapacity()) {
-      return false;
+void ProposeQueue::ReleaseRequest(ProposeRequest* r) {
+  // Keep the buffer of the value, but not the things captured by the
+  // functions.
+  r->handler = nullptr;
+  r->cb = nullptr;
+  r->value.clear();
+  r->context = nullptr;
+  r->status = Status::OK();
+  {
+    MutexLock lock(&mutex_);
+    if (free_requests_.size() < kMaxFreeRequests) {
+      free_requests_.push_back(r);
+      return;
     }
-    propose_queue_.push(std::move(f));
   }
-  cb_queue_.push(cb);
-  return true;
+  delete r;
 }
 
-bool ProposeQueue::Put(const ProposeHandler& f, ProposeCompleteCallback&& cb) {
-  MutexLock lock(&mutex_);
-  if (last_finished_) {
-    last_finished_ = false;
-    io_loop_->QueueInLoop(f);
-  } else {
-    if (!CheckCapacity()) {
-      return false;
-    }
-    propose_queue_.push(f);
+bool ProposeQueue::CheckCapacity() const {
+  if (capacity_ != 0 && waiting_.size() > capacity_) {
+    LOG_WARN("Too many proposals are waiting to be proposed!");
+    return false;
   }
-  cb_queue_.push(std::move(cb));
   return true;
 }
 
-bool ProposeQueue::Put(ProposeHandler&& f, ProposeCompleteCallback&& cb) {
-  MutexLock lock(&mutex_);
-  if (last_finished_) {
-    last_finished_ = false;
-    io_loop_->QueueInLoop(std::move(f));
-  } else {
-    if (!CheckCapacity()) {
-      return false;
+bool ProposeQueue::Put(ProposeRequest* r) {
+  {
+    MutexLock lock(&mutex_);
+    if (running_ < window_) {
+      ++running_;
+      io_loop_->QueueInLoop([r]() { r->handler(); });
+      requests_.push(r);
+      return true;
+    }
+    if (CheckCapacity()) {
+      waiting_.push(r);
+      requests_.push(r);
+      return true;
     }
-    propose_queue_.push(std::move(f));
   }
-  cb_queue_.push(std::move(cb));
-  return true;
+  ReleaseRequest(r);
+  return false;
+}
+
+bool ProposeQueue::Put(ProposeHandler&& f, const ProposeCompleteCallback& cb) {
+  ProposeRequest* r = NewRequest();
+  r->handler = std::move(f);
+  r->cb = cb;
+  return Put(r);
+}
+
+bool ProposeQueue::Put(ProposeHandler&& f, ProposeCompleteCallback&& cb) {
+  ProposeRequest* r = NewRequest();
+  r->handler = std::move(f);
+  r->cb = std::move(cb);
+  return Put(r);
 }
 
 void ProposeQueue::ProposeComplete(uint64_t instance_id, const Status& s,
                                    void* context) {
   MutexLock lock(&mutex_);
-  assert(!last_finished_);
-  assert(!cb_queue_.empty());
-  ProposeCompleteCallback cb = cb_queue_.front();
-  cb_queue_.pop();
-  callback_loop_->QueueInLoop(
-      [cb, context, s, instance_id]() { cb(instance_id, s, context); });
-
-  if (!propose_queue_.empty()) {
-    io_loop_->QueueInLoop(propose_queue_.front());
-    propose_queue_.pop();
+  assert(running_ > 0);
+  assert(!requests_.empty());
+  ProposeRequest* r = requests_.front();
+  requests_.pop();
+  r->instance_id = instance_id;
+  r->status = s;
+  r->context = context;
+  callback_loop_->QueueInLoop([this, r]() { Complete(r); });
+
+  if (!waiting_.empty()) {
+    ProposeRequest* next = waiting_.front();
+    waiting_.pop();
+    io_loop_->QueueInLoop([next]() { next->handler(); });
   } else {
-    last_finished_ = true;
+    --running_;
   }
 }
 
+void ProposeQueue::Complete(ProposeRequest* r) {
+  r->cb(r->instance_id, r->status, r->context);
+  ReleaseRequest(r);
+}
+
 }  // namespace skywalker
@@ -6,6 +6,9 @@
 #define SKYWALKER_PAXOS_PROPOSE_QUEUE_H_
 
 #include <queue>
+#include <string>
+#include <vector>
+
 #include "skywalker/options.h"
 #include "skywalker/state_machine.h"
 #include "skywalker/status.h"
@@ -18,32 +21,59 @@ class Group;
 
 typedef std::function<void()> ProposeHandler;
 
+// A proposal from being put into the queue until its callback is called.
+// The value and the callback are moved along with it instead of being
+// copied, and the requests are reused by the later proposals.
+struct ProposeRequest {
+  ProposeRequest() : machine_id(0), context(nullptr), instance_id(0) {}
+  ProposeHandler handler;
+  uint32_t machine_id;
+  std::string value;
+  void* context;
+  ProposeCompleteCallback cb;
+  uint64_t instance_id;
+  Status status;
+};
+
 class ProposeQueue {
  public:
-  explicit ProposeQueue(size_t capacity = 0);
+  // At most window proposals are dispatched to the io loop before
+  // they are completed, the completions must be in the dispatched order.
+  explicit ProposeQueue(size_t capacity = 0, size_t window = 1);
   ~ProposeQueue();
 
   void SetIOLoop(RunLoop* loop) { io_loop_ = loop; }
   void SetCallbackLoop(RunLoop* loop) { callback_loop_ = loop; }
 
-  bool Put(const ProposeHandler& f, const ProposeCompleteCallback& cb);
+  ProposeRequest* NewRequest();
+  void ReleaseRequest(ProposeRequest* r);
+
+  // The request is released if it isn't put into the queue.
+  bool Put(ProposeRequest* r);
+
   bool Put(ProposeHandler&& f, const ProposeCompleteCallback& cb);
-  bool Put(const ProposeHandler& f, ProposeCompleteCallback&& cb);
   bool Put(ProposeHandler&& f, ProposeCompleteCallback&& cb);
 
  private:
   friend class Group;
+  static const size_t kMaxFreeRequests = 1024;
+
   bool CheckCapacity() const;
   void ProposeComplete(uint64_t instance_id, const Status& s, void* context);
+  void Complete(ProposeRequest* r);
 
   size_t capacity_;
+  size_t window_;
   RunLoop* io_loop_;
   RunLoop* callback_loop_;
 
   Mutex mutex_;
-  bool last_finished_;
-  std::queue<ProposeHandler> propose_queue_;
-  std::queue<ProposeCompleteCallback> cb_queue_;
+  size_t running_;
+  // The requests_ has all the requests in the order they are put,
+  // and the waiting_ has the ones which haven't been dispatched.
+  std::queue<ProposeRequest*> waiting_;
+  std::queue<ProposeRequest*> requests_;
+  std::vector<ProposeRequest*> free_requests_;
 
   // No copying allowed
   ProposeQueue(const ProposeQueue&);
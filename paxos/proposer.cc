@@ -17,33 +17,45 @@ Proposer::Proposer(Config* config, Instance* instance)
     : config_(config),
       instance_(instance),
       messager_(config->GetMessager()),
-      counter_(config),
       instance_id_(0),
       proposal_id_(0),
       max_proprosal_id_(0),
-      max_ballot_(),
-      value_(),
       preparing_(false),
-      accepting_(false),
       skip_prepare_(false),
       was_rejected_by_someone_(false),
+      retry_instance_id_(0),
       rand_(static_cast<uint32_t>(NowMillis())) {}
 
-void Proposer::NewPropose(const PaxosValue& value) {
-  value_ = value;
-  if (skip_prepare_ && !was_rejected_by_someone_) {
-    Accept();
-  } else {
-    Prepare(was_rejected_by_someone_);
+void Proposer::NewPropose(const PaxosValuePtr& value) {
+  Slot* slot = NewSlot();
+  if (!slot->value) {
+    slot->value = value;
+  }
+  if (slots_.size() == 1) {
+    if (skip_prepare_ && !was_rejected_by_someone_) {
+      Accept(instance_id_);
+    } else {
+      Prepare(was_rejected_by_someone_);
+    }
+  } else if (skip_prepare_ && !preparing_ && !was_rejected_by_someone_) {
+    // The previous instances are still in the accept phase,
+    // use the same proposal_id to accept the new instance.
+    Accept(instance_id_ + slots_.size() - 1);
   }
 }
 
 void Proposer::Prepare(bool need_new_proposal_id) {
+  if (slots_.empty()) {
+    return;
+  }
   preparing_ = true;
-  accepting_ = false;
   skip_prepare_ = false;
   was_rejected_by_someone_ = false;
-  max_ballot_.Reset();
+  recovered_.clear();
+  for (auto& slot : slots_) {
+    slot.accepting = false;
+    slot.max_ballot.Reset();
+  }
 
   if (need_new_proposal_id) {
     if (proposal_id_ < max_proprosal_id_) {
@@ -65,11 +77,14 @@ void Proposer::Prepare(bool need_new_proposal_id) {
   msg->set_node_id(config_->GetNodeId());
   msg->set_instance_id(instance_id_);
   msg->set_proposal_id(proposal_id_);
+  msg->set_propose_window(config_->ProposeWindow());
 
-  counter_.StartNewRound();
+  // The same view is used to count the votes and to send the messages.
+  std::shared_ptr<const MembershipView> view = config_->GetView();
+  counter_.StartNewRound(view, Counter::kPrepare);
   AddRetryTimer();
 
-  messager_->BroadcastMessage(content);
+  messager_->BroadcastMessage(view, content);
   instance_->OnPaxosMessage(*msg);
 }
 
@@ -80,9 +95,26 @@ void Proposer::OnPrepareReply(const PaxosMessage& msg) {
     if (msg.rejected_id() == 0) {
       counter_.AddPromisorOrAcceptor(msg.node_id());
       BallotNumber b(msg.pre_accepted_id(), msg.pre_accepted_node_id());
-      if (b > max_ballot_) {
-        max_ballot_ = b;
-        value_ = msg.value();
+      if (b > slots_.front().max_ballot) {
+        slots_.front().max_ballot = b;
+        slots_.front().value = std::make_shared<PaxosValue>(msg.value());
+      }
+      // The acceptor has accepted some values of the later instances
+      // in the pipeline, they must be proposed again on the same instances.
+      for (const PaxosInstance& p : msg.accepted_instances()) {
+        if (p.instance_id() <= instance_id_ ||
+            p.instance_id() >= instance_id_ + config_->ProposeWindow()) {
+          continue;
+        }
+        Slot* slot = GetSlot(p.instance_id());
+        if (slot == nullptr) {
+          slot = &recovered_[p.instance_id()];
+        }
+        BallotNumber pb(p.accepted_id(), p.accepted_node_id());
+        if (pb > slot->max_ballot) {
+          slot->max_ballot = pb;
+          slot->value = std::make_shared<PaxosValue>(p.accepted_value());
+        }
       }
     } else {
       counter_.AddRejector(msg.node_id());
@@ -93,25 +125,36 @@ void Proposer::OnPrepareReply(const PaxosMessage& msg) {
       preparing_ = false;
       skip_prepare_ = true;
       RemoveRetryTimer();
-      Accept();
+      AcceptAll();
     } else if (counter_.IsRejectedOnThisRound() ||
                counter_.IsReceiveAllOnThisRound()) {
       LOG_DEBUG("Group %u - prepare not pass, reprepare about 30ms later.",
                 config_->GetGroupId());
       preparing_ = false;
-      RemoveRetryTimer();
       AddRetryTimer((rand_.Uniform(15) + 15) * 1000);
     }
   }
   SetMaxProposalId(msg);
 }
 
-void Proposer::Accept() {
+void Proposer::AcceptAll() {
+  // The instance may go forward while accepting, so don't hold the slot.
+  uint64_t end = instance_id_ + slots_.size();
+  for (uint64_t id = instance_id_; id < end; ++id) {
+    if (GetSlot(id) != nullptr) {
+      Accept(id);
+    }
+  }
+}
+
+void Proposer::Accept(uint64_t instance_id) {
+  Slot* slot = GetSlot(instance_id);
+  assert(slot != nullptr);
   preparing_ = false;
-  accepting_ = true;
+  slot->accepting = true;
   LOG_DEBUG(
       "Group %u - start to accept, the instance_id=%llu, proposal_id=%llu.",
-      config_->GetGroupId(), (unsigned long long)instance_id_,
+      config_->GetGroupId(), (unsigned long long)instance_id,
       (unsigned long long)proposal_id_);
 
   Content content;
@@ -120,37 +163,53 @@ void Proposer::Accept() {
   PaxosMessage* msg = content.mutable_paxos_msg();
   msg->set_type(ACCEPT);
   msg->set_node_id(config_->GetNodeId());
-  msg->set_instance_id(instance_id_);
+  msg->set_instance_id(instance_id);
   msg->set_proposal_id(proposal_id_);
-  *(msg->mutable_value()) = value_;
+  msg->set_propose_window(config_->ProposeWindow());
+  if (!slot->value) {
+    // No value has been accepted on the gap, so fill it with a no-op.
+    std::shared_ptr<PaxosValue> noop(std::make_shared<PaxosValue>());
+    noop->set_noop(true);
+    slot->value = noop;
+  }
+  // The slot may be removed while the local acceptor handles it.
+  PaxosValuePtr value = slot->value;
 
-  counter_.StartNewRound();
+  std::shared_ptr<const MembershipView> view = config_->GetView();
+  slot->counter.StartNewRound(view, Counter::kAccept);
   AddRetryTimer();
 
-  messager_->BroadcastMessage(content);
-  instance_->OnPaxosMessage(*msg);
+  {
+    ValueLender lender(msg, value);
+    messager_->BroadcastMessage(view, content);
+  }
+  instance_->OnPaxosMessage(*msg, value);
 }
 
 void Proposer::OnAccpetReply(const PaxosMessage& msg) {
-  if (accepting_ && (msg.instance_id() == instance_id_)) {
-    counter_.AddReceivedNode(msg.node_id());
+  Slot* slot = GetSlot(msg.instance_id());
+  if (slot != nullptr && slot->accepting) {
+    slot->counter.AddReceivedNode(msg.node_id());
     if (msg.rejected_id() == 0) {
-      counter_.AddPromisorOrAcceptor(msg.node_id());
+      slot->counter.AddPromisorOrAcceptor(msg.node_id());
     } else {
-      counter_.AddRejector(msg.node_id());
+      slot->counter.AddRejector(msg.node_id());
     }
 
-    if (counter_.IsPassedOnThisRound()) {
+    if (slot->counter.IsPassedOnThisRound()) {
       LOG_DEBUG("Group %u - accept pass.", config_->GetGroupId());
-      accepting_ = false;
-      RemoveRetryTimer();
-      NewChosenValue();
-    } else if (counter_.IsRejectedOnThisRound() ||
-               counter_.IsReceiveAllOnThisRound()) {
+      slot->accepting = false;
+      if (msg.instance_id() == instance_id_) {
+        RemoveRetryTimer();
+      }
+      NewChosenValue(msg.instance_id(), *slot->value);
+    } else if (slot->counter.IsRejectedOnThisRound() ||
+               slot->counter.IsReceiveAllOnThisRound()) {
       LOG_DEBUG("Group %u - accept not pass, reprepare about 30ms later.",
                 config_->GetGroupId());
-      accepting_ = false;
-      RemoveRetryTimer();
+      for (auto& s : slots_) {
+        s.accepting = false;
+      }
       AddRetryTimer((rand_.Uniform(15) + 15) * 1000);
     }
   }
@@ -167,39 +226,98 @@ void Proposer::SetMaxProposalId(const PaxosMessage& msg) {
   }
 }
 
-void Proposer::NewChosenValue() {
+void Proposer::NewChosenValue(uint64_t instance_id, const PaxosValue& value) {
   Content content;
   content.set_type(PAXOS_MESSAGE);
   content.set_group_id(config_->GetGroupId());
   PaxosMessage* msg = content.mutable_paxos_msg();
   msg->set_type(NEW_CHOSEN_VALUE);
   msg->set_node_id(config_->GetNodeId());
-  msg->set_instance_id(instance_id_);
+  msg->set_instance_id(instance_id);
   msg->set_proposal_id(proposal_id_);
-  if (value_.ByteSizeLong() <= 64) {
-    *(msg->mutable_value()) = value_;
+  if (value.ByteSizeLong() <= 64) {
+    *(msg->mutable_value()) = value;
   }
   messager_->BroadcastMessage(content);
   instance_->OnPaxosMessage(*msg);
 }
 
+Proposer::Slot* Proposer::GetSlot(uint64_t instance_id) {
+  if (instance_id < instance_id_ ||
+      instance_id - instance_id_ >= slots_.size()) {
+    return nullptr;
+  }
+  return &slots_[instance_id - instance_id_];
+}
+
+// A value recovered on the instance of the new slot is proposed instead of
+// the new one, whose proposal ends with a conflict.
+Proposer::Slot* Proposer::NewSlot() {
+  uint64_t instance_id = instance_id_ + slots_.size();
+  slots_.push_back(Slot());
+  Slot* slot = &slots_.back();
+  auto it = recovered_.find(instance_id);
+  if (it != recovered_.end()) {
+    slot->max_ballot = it->second.max_ballot;
+    slot->value = it->second.value;
+    recovered_.erase(it);
+  }
+  return slot;
+}
+
+// The retry timer is restarted in place if it hasn't run.
 void Proposer::AddRetryTimer(uint64_t timeout) {
-  uint64_t id = instance_id_;
-  retry_timer_ = io_loop_->RunAfter(timeout, [id, this]() {
-    if (id == instance_id_) {
-      Prepare(was_rejected_by_someone_);
+  retry_instance_id_ = instance_id_;
+  if (io_loop_->Restart(retry_timer_, timeout)) {
+    return;
+  }
+  retry_timer_ = io_loop_->RunAfter(timeout, [this]() {
+    retry_timer_ = TimerId();
+    if (retry_instance_id_ == instance_id_) {
+      if (IsStableMaster()) {
+        // Nobody has a larger ballot, so the accepts with the same ballot
+        // and the same values are still safe.
+        AcceptAll();
+      } else {
+        Prepare(was_rejected_by_someone_);
+      }
     }
   });
 }
 
-void Proposer::RemoveRetryTimer() { io_loop_->Remove(retry_timer_); }
+bool Proposer::IsStableMaster() const {
+  return config_->StableMaster() && skip_prepare_ && !preparing_ &&
+         !was_rejected_by_someone_ && config_->GetMasterMachine()->IsMaster();
+}
+
+void Proposer::RemoveRetryTimer() {
+  io_loop_->Remove(retry_timer_);
+  retry_timer_ = TimerId();
+}
 
 void Proposer::QuitPropose() {
   preparing_ = false;
-  accepting_ = false;
+  slots_.clear();
+  recovered_.clear();
   RemoveRetryTimer();
 }
 
-void Proposer::NextInstance() { ++instance_id_; }
+void Proposer::SkipTo(uint64_t instance_id) {
+  QuitPropose();
+  instance_id_ = instance_id;
+}
+
+void Proposer::NextInstance() {
+  ++instance_id_;
+  recovered_.erase(instance_id_ - 1);
+  if (!slots_.empty()) {
+    slots_.pop_front();
+    // Restart the retry timer for the instances still in the pipeline,
+    // reprepare on the new instance at once if the prepare isn't finished.
+    if (!slots_.empty()) {
+      AddRetryTimer(preparing_ ? 0 : 200000);
+    }
+  }
+}
 
 }  // namespace skywalker
@@ -5,8 +5,12 @@
 #ifndef SKYWALKER_PAXOS_PROPOSER_H_
 #define SKYWALKER_PAXOS_PROPOSER_H_
 
+#include <deque>
+#include <map>
+
 #include "paxos/ballot_number.h"
 #include "paxos/counter.h"
+#include "paxos/paxos_value.h"
 #include "proto/paxos.pb.h"
 #include "util/random.h"
 #include "util/runloop.h"
@@ -24,11 +28,13 @@ class Proposer {
 
   void SetInstanceId(uint64_t id) { instance_id_ = id; }
   void SetStartProposalId(uint64_t id) { proposal_id_ = id; }
-  void SetNoSkipPrepare() { skip_prepare_ = false; }
 
   void SetIOLoop(RunLoop* loop) { io_loop_ = loop; }
 
-  void NewPropose(const PaxosValue& value);
+  // The instance_id which the next new proposal will be proposed on.
+  uint64_t GetNextInstanceId() const { return instance_id_ + slots_.size(); }
+
+  void NewPropose(const PaxosValuePtr& value);
 
   void OnPrepareReply(const PaxosMessage& msg);
   void OnAccpetReply(const PaxosMessage& msg);
@@ -36,16 +42,30 @@ class Proposer {
   void QuitPropose();
 
   void NextInstance();
+  void SkipTo(uint64_t instance_id);
 
  private:
+  struct Slot {
+    Slot() : accepting(false) {}
+
+    PaxosValuePtr value;
+    BallotNumber max_ballot;
+    Counter counter;
+    bool accepting;
+  };
+
   void Prepare(bool need_new_proposal_id = true);
-  void Accept();
+  void Accept(uint64_t instance_id);
+  void AcceptAll();
+  Slot* GetSlot(uint64_t instance_id);
+  Slot* NewSlot();
 
+  bool IsStableMaster() const;
   void RemoveRetryTimer();
   void AddRetryTimer(uint64_t timeout = 200000);
 
   void SetMaxProposalId(const PaxosMessage& msg);
-  void NewChosenValue();
+  void NewChosenValue(uint64_t instance_id, const PaxosValue& value);
 
   Config* config_;
   Instance* instance_;
@@ -57,15 +77,21 @@ class Proposer {
   uint64_t instance_id_;
   uint64_t proposal_id_;
   uint64_t max_proprosal_id_;
-  BallotNumber max_ballot_;
-  PaxosValue value_;
+
+  // The slots_[i] is for the instance (instance_id_ + i), at most
+  // config_->ProposeWindow() slots are in the accept phase together.
+  std::deque<Slot> slots_;
+  // The values which the promisors of the last prepare have accepted on
+  // the later instances without a slot. Each slot is for a proposal of the
+  // instance, so they are taken when the proposals come.
+  std::map<uint64_t, Slot> recovered_;
 
   bool preparing_;
-  bool accepting_;
   bool skip_prepare_;
   bool was_rejected_by_someone_;
 
   TimerId retry_timer_;
+  uint64_t retry_instance_id_;
   Random rand_;
 
   // No copying allowed
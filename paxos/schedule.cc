@@ -8,22 +8,16 @@
 
 namespace skywalker {
 
-ThreadPool::ThreadPool() : started_(false), io_next_(0), callback_next_(0) {}
+ThreadPool::ThreadPool() : started_(false), callback_next_(0) {}
 
 void ThreadPool::Start(uint32_t io_thread_size, uint32_t callback_thread_size) {
   assert(!started_);
   started_ = true;
 
-  io_loops_.reserve(io_thread_size);
   callback_loops_.reserve(callback_thread_size);
-  io_threads_.reserve(io_thread_size);
   callback_threads_.reserve(callback_thread_size);
 
-  for (uint32_t i = 0; i < io_thread_size; ++i) {
-    RunLoopThread* thread = new RunLoopThread();
-    io_loops_.push_back(thread->Loop());
-    io_threads_.push_back(std::unique_ptr<RunLoopThread>(thread));
-  }
+  io_scheduler_.Start(io_thread_size);
   for (uint32_t i = 0; i < callback_thread_size; ++i) {
     RunLoopThread* thread = new RunLoopThread();
     callback_loops_.push_back(thread->Loop());
@@ -31,12 +25,9 @@ void ThreadPool::Start(uint32_t io_thread_size, uint32_t callback_thread_size) {
   }
 }
 
-RunLoop* ThreadPool::GetNextIOLoop() {
+RunLoop* ThreadPool::NewIOLoop() {
   assert(started_);
-  if (io_next_ == io_loops_.size()) {
-    io_next_ = 0;
-  }
-  return io_loops_[io_next_++];
+  return io_scheduler_.NewLoop();
 }
 
 RunLoop* ThreadPool::GetNextCallbackLoop() {
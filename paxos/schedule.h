@@ -10,6 +10,7 @@
 
 #include "util/runloop.h"
 #include "util/runloop_thread.h"
+#include "util/scheduler.h"
 
 namespace skywalker {
 
@@ -19,19 +20,18 @@ class ThreadPool {
 
   void Start(uint32_t io_thread_size, uint32_t callback_thread_size);
 
-  RunLoop* GetNextIOLoop();
+  // Every group has a loop of its own, which is run by the io threads.
+  RunLoop* NewIOLoop();
 
   RunLoop* GetNextCallbackLoop();
 
  private:
   bool started_;
-  uint32_t io_next_;
   uint32_t callback_next_;
 
-  std::vector<RunLoop*> io_loops_;
   std::vector<RunLoop*> callback_loops_;
 
-  std::vector<std::unique_ptr<RunLoopThread>> io_threads_;
+  Scheduler io_scheduler_;
   std::vector<std::unique_ptr<RunLoopThread>> callback_threads_;
 
   // No copying allowed
@@ -0,0 +1,122 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+
+#include "machine/membership_view.h"
+#include "paxos/counter.h"
+#include "proto/paxos.pb.h"
+#include "util/testharness.h"
+
+namespace skywalker {
+
+// The members are 100, 200, ..., node_size * 100.
+static std::shared_ptr<const MembershipView> NewView(size_t node_size,
+                                                     uint32_t phase1,
+                                                     uint32_t phase2) {
+  Membership membership;
+  membership.set_version(1);
+  for (uint64_t i = 1; i <= node_size; ++i) {
+    MemberMessage member;
+    member.set_id(i * 100);
+    (*membership.mutable_members())[i * 100] = member;
+  }
+  return std::make_shared<MembershipView>(membership, phase1, phase2);
+}
+
+TEST(CounterTest, Majority) {
+  Counter counter;
+  counter.StartNewRound(NewView(3, 0, 0), Counter::kAccept);
+  counter.AddReceivedNode(100);
+  counter.AddPromisorOrAcceptor(100);
+  CHECK(!counter.IsPassedOnThisRound());
+
+  // A vote is counted once, and the nodes out of the view are ignored.
+  counter.AddReceivedNode(100);
+  counter.AddPromisorOrAcceptor(100);
+  counter.AddReceivedNode(400);
+  counter.AddPromisorOrAcceptor(400);
+  CHECK(!counter.IsPassedOnThisRound());
+
+  counter.AddReceivedNode(300);
+  counter.AddPromisorOrAcceptor(300);
+  CHECK(counter.IsPassedOnThisRound());
+  CHECK(!counter.IsRejectedOnThisRound());
+  CHECK(!counter.IsReceiveAllOnThisRound());
+
+  counter.AddReceivedNode(200);
+  CHECK(counter.IsReceiveAllOnThisRound());
+}
+
+TEST(CounterTest, Rejected) {
+  Counter counter;
+  counter.StartNewRound(NewView(5, 0, 0), Counter::kPrepare);
+  counter.AddRejector(100);
+  counter.AddRejector(200);
+  CHECK(!counter.IsRejectedOnThisRound());
+  counter.AddRejector(200);
+  CHECK(!counter.IsRejectedOnThisRound());
+  // Three rejectors leave less than a majority of five.
+  counter.AddRejector(500);
+  CHECK(counter.IsRejectedOnThisRound());
+
+  // A new round forgets the votes.
+  counter.StartNewRound(NewView(5, 0, 0), Counter::kPrepare);
+  CHECK(!counter.IsRejectedOnThisRound());
+  CHECK(!counter.IsPassedOnThisRound());
+}
+
+// The votes of the members past the first word of the bitset.
+TEST(CounterTest, ManyNodes) {
+  const size_t kNodes = 130;
+  Counter counter;
+  counter.StartNewRound(NewView(kNodes, 0, 0), Counter::kAccept);
+  for (uint64_t i = kNodes; i > kNodes / 2; --i) {
+    counter.AddPromisorOrAcceptor(i * 100);
+  }
+  CHECK(!counter.IsPassedOnThisRound());
+  counter.AddPromisorOrAcceptor(100);
+  CHECK(counter.IsPassedOnThisRound());
+
+  for (uint64_t i = 1; i <= kNodes; ++i) {
+    CHECK(!counter.IsReceiveAllOnThisRound());
+    counter.AddReceivedNode(i * 100);
+  }
+  CHECK(counter.IsReceiveAllOnThisRound());
+}
+
+TEST(CounterTest, FlexibleQuorums) {
+  std::shared_ptr<const MembershipView> view = NewView(5, 4, 2);
+
+  Counter prepare;
+  prepare.StartNewRound(view, Counter::kPrepare);
+  prepare.AddPromisorOrAcceptor(100);
+  prepare.AddPromisorOrAcceptor(200);
+  prepare.AddPromisorOrAcceptor(300);
+  CHECK(!prepare.IsPassedOnThisRound());
+  prepare.AddPromisorOrAcceptor(400);
+  CHECK(prepare.IsPassedOnThisRound());
+  // Two rejectors leave less than four promisors.
+  prepare.AddRejector(500);
+  CHECK(!prepare.IsRejectedOnThisRound());
+  prepare.AddRejector(400);
+  CHECK(prepare.IsRejectedOnThisRound());
+
+  Counter accept;
+  accept.StartNewRound(view, Counter::kAccept);
+  accept.AddPromisorOrAcceptor(100);
+  CHECK(!accept.IsPassedOnThisRound());
+  accept.AddPromisorOrAcceptor(500);
+  CHECK(accept.IsPassedOnThisRound());
+  accept.AddRejector(100);
+  accept.AddRejector(200);
+  accept.AddRejector(300);
+  CHECK(!accept.IsRejectedOnThisRound());
+  accept.AddRejector(400);
+  CHECK(accept.IsRejectedOnThisRound());
+}
+
+}  // namespace skywalker
+
+int main() { return skywalker::test::RunAllTests(); }
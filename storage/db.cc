@@ -4,12 +4,15 @@
 
 #include "storage/db.h"
 
-#include <leveldb/options.h>
-#include <leveldb/status.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "paxos/config.h"
-#include "skywalker/logging.h"
+#include "storage/leveldb_storage.h"
+#include "storage/segment_storage.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace skywalker {
 
@@ -17,114 +20,171 @@ namespace {
 static const uint64_t kMinChosenKey = UINTMAX_MAX;
 static const uint64_t kMembership = (UINTMAX_MAX - 1);
 static const uint64_t kMasterState = (UINTMAX_MAX - 2);
+static const uint64_t kMaxChosenKey = (UINTMAX_MAX - 3);
 }  // namespace
 
-int Comparator::Compare(const leveldb::Slice& a,
-                        const leveldb::Slice& b) const {
-  uint64_t key = DecodeFixed64(a.data());
-  uint64_t key2 = DecodeFixed64(b.data());
-  if (key == key2) {
-    return 0;
-  }
-  return key > key2 ? 1 : -1;
-}
-
-DB::DB(Config* config) : config_(config), db_(nullptr) {}
+DB::DB(Config* config)
+    : config_(config),
+      storage_(nullptr),
+      mutex_(),
+      chosen_end_(0),
+      max_chosen_id_(0) {}
 
-DB::~DB() { delete db_; }
+DB::~DB() { delete storage_; }
 
 int DB::Open(const std::string& name) {
-  leveldb::Options options;
-  options.comparator = &comparator_;
-  options.create_if_missing = true;
-  options.write_buffer_size = 1024 * 1024 + config_->GetGroupId() * 10 * 1024;
-  leveldb::Status status = leveldb::DB::Open(options, name, &db_);
-  if (!status.ok()) {
-    LOG_ERROR("DB::Open - %s", status.ToString().c_str());
-    return -1;
+  if (config_->GetLogStorageType() == kSegmentStorage) {
+    storage_ = new SegmentStorage(config_->SegmentSize());
+  } else {
+    storage_ = new LevelDBStorage(1024 * 1024 +
+                                  config_->GetGroupId() * 10 * 1024);
+  }
+  int ret = storage_->Open(name);
+  if (ret == 0) {
+    GetMaxChosenInstanceId(&max_chosen_id_);
   }
-  return 0;
+  return ret;
 }
 
 int DB::Put(const WriteOptions& options, uint64_t instance_id,
             const std::string& value) {
-  char key[sizeof(instance_id)];
-  EncodeFixed64(key, instance_id);
-  leveldb::WriteOptions op;
-  op.sync = options.sync;
-  leveldb::Status status =
-      db_->Put(op, leveldb::Slice(key, sizeof(key)), value);
-  if (!status.ok()) {
-    LOG_ERROR("DB::Put - %s", status.ToString().c_str());
-    return -1;
-  }
-  return 0;
+  return storage_->Put(options, instance_id, value);
 }
 
 int DB::Delete(const WriteOptions& options, uint64_t instance_id) {
-  char key[sizeof(instance_id)];
-  EncodeFixed64(key, instance_id);
-  leveldb::WriteOptions op;
-  op.sync = options.sync;
-  leveldb::Status status = db_->Delete(op, leveldb::Slice(key, sizeof(key)));
-  if (!status.ok()) {
-    LOG_ERROR("DB::Delete - %s", status.ToString().c_str());
-    return -1;
-  }
-  return 0;
+  return storage_->Delete(options, instance_id);
 }
 
 int DB::Write(const WriteOptions& options, WriteBatch* updates) {
-  leveldb::WriteOptions op;
-  op.sync = options.sync;
-  leveldb::Status status = db_->Write(op, updates->batch_);
-  if (!status.ok()) {
-    LOG_ERROR("DB::Write - %s", status.ToString().c_str());
-    return -1;
-  }
-  return 0;
+  return storage_->Write(options, updates);
 }
 
-int DB::Get(uint64_t instance_id, std::string* value) {
-  char key[sizeof(instance_id)];
-  EncodeFixed64(key, instance_id);
-  leveldb::Status status =
-      db_->Get(leveldb::ReadOptions(), leveldb::Slice(key, sizeof(key)), value);
-  int ret = 0;
-  if (!status.ok()) {
-    if (status.IsNotFound()) {
-      ret = 1;
-    } else {
-      ret = -1;
-      LOG_ERROR("DB::Get - %s", status.ToString().c_str());
+int DB::WriteChosen(const WriteOptions& options, WriteBatch* updates,
+                    uint64_t end) {
+  MutexLock lock(&mutex_);
+  DropStale(updates, false);
+  int ret = storage_->Write(options, updates);
+  if (ret == 0) {
+    if (end > chosen_end_) {
+      chosen_end_ = end;
     }
+    UpdateMaxChosen(*updates);
   }
+  return ret;
+}
 
+int DB::WriteAccepted(const WriteOptions& options, WriteBatch* updates) {
+  MutexLock lock(&mutex_);
+  DropStale(updates, true);
+  if (updates->Count() == 0) {
+    return 0;
+  }
+  int ret = storage_->Write(options, updates);
+  if (ret == 0) {
+    UpdateMaxChosen(*updates);
+  }
   return ret;
 }
 
-int DB::GetMaxInstanceId(uint64_t* instance_id) {
-  int ret = 1;
-  leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
-  it->SeekToLast();
-  while (it->Valid()) {
-    uint64_t id = DecodeFixed64(it->key().data());
-    if (id == kMinChosenKey || id == kMembership || id == kMasterState) {
-      it->Prev();
-    } else {
-      *instance_id = id;
-      ret = 0;
-      break;
+// The acceptor's promise and acceptance of an instance only go up, and so
+// do the ones of the chosen record written by the learner, so an older
+// record has lower ones.
+int DB::WriteReplayed(WriteBatch* updates) {
+  uint64_t min_chosen_id = 0;
+  if (GetMinChosenInstanceId(&min_chosen_id) == -1) {
+    return -1;
+  }
+  std::vector<WriteBatch::Op>& ops = updates->ops_;
+  PaxosInstance replayed, written;
+  std::string s;
+  auto it = ops.begin();
+  while (it != ops.end()) {
+    if (it->instance_id == kMaxChosenKey || it->deleted) {
+      ++it;
+      continue;
+    }
+    if (it->instance_id < min_chosen_id) {
+      it = ops.erase(it);
+      continue;
+    }
+    int ret = Get(it->instance_id, &s);
+    if (ret == -1) {
+      return -1;
     }
+    if (ret == 0 && written.ParseFromString(s) &&
+        replayed.ParseFromString(it->value)) {
+      auto a = std::make_pair(replayed.accepted_id(),
+                              replayed.accepted_node_id());
+      auto b = std::make_pair(written.accepted_id(),
+                              written.accepted_node_id());
+      auto p = std::make_pair(replayed.promised_id(),
+                              replayed.promised_node_id());
+      auto q = std::make_pair(written.promised_id(),
+                              written.promised_node_id());
+      if (a < b || (a == b && p <= q)) {
+        it = ops.erase(it);
+        continue;
+      }
+      if (p < q) {
+        replayed.set_promised_id(written.promised_id());
+        replayed.set_promised_node_id(written.promised_node_id());
+        replayed.SerializeToString(&it->value);
+      }
+    }
+    ++it;
   }
-  delete it;
-  return ret;
+  if (ops.empty()) {
+    return 0;
+  }
+  WriteOptions options;
+  options.sync = false;
+  return WriteAccepted(options, updates);
 }
 
+int DB::Sync() { return storage_->Sync(); }
+
+// The max chosen instance_id is written with the records, it mustn't go
+// back because of a late batch.
+void DB::DropStale(WriteBatch* updates, bool accepted) {
+  std::vector<WriteBatch::Op>& ops = updates->ops_;
+  ops.erase(std::remove_if(ops.begin(), ops.end(),
+                           [this, accepted](const WriteBatch::Op& op) {
+                             if (op.instance_id == kMaxChosenKey) {
+                               return DecodeFixed64(op.value.data()) <
+                                      max_chosen_id_;
+                             }
+                             return accepted && op.instance_id < chosen_end_;
+                           }),
+            ops.end());
+}
+
+void DB::UpdateMaxChosen(const WriteBatch& updates) {
+  for (auto& op : updates.ops_) {
+    if (op.instance_id == kMaxChosenKey) {
+      max_chosen_id_ = DecodeFixed64(op.value.data());
+    }
+  }
+}
+
+int DB::Get(uint64_t instance_id, std::string* value) {
+  return storage_->Get(instance_id, value);
+}
+
+// The keys of the states are the largest ones.
+int DB::GetMaxInstanceId(uint64_t* instance_id) {
+  return storage_->GetMaxKey(kMaxChosenKey, instance_id);
+}
+
+LogIterator* DB::NewIterator() { return storage_->NewIterator(); }
+
+// The log before the min chosen one is missing, so nothing can be
+// accepted there any more.
 int DB::SetMinChosenInstanceId(uint64_t id) {
   char value[sizeof(id)];
   EncodeFixed64(value, id);
-  return Put(WriteOptions(), kMinChosenKey, std::string(value, sizeof(value)));
+  WriteBatch batch;
+  batch.Put(kMinChosenKey, std::string(value, sizeof(value)));
+  return WriteChosen(WriteOptions(), &batch, id);
 }
 
 int DB::GetMinChosenInstanceId(uint64_t* id) {
@@ -136,6 +196,21 @@ int DB::GetMinChosenInstanceId(uint64_t* id) {
   return ret;
 }
 
+void DB::SetMaxChosenInstanceId(uint64_t id, WriteBatch* updates) {
+  char value[sizeof(id)];
+  EncodeFixed64(value, id);
+  updates->Put(kMaxChosenKey, std::string(value, sizeof(value)));
+}
+
+int DB::GetMaxChosenInstanceId(uint64_t* id) {
+  std::string value;
+  int ret = Get(kMaxChosenKey, &value);
+  if (ret == 0) {
+    *id = DecodeFixed64(value.data());
+  }
+  return ret;
+}
+
 int DB::SetMembership(const Membership& m) {
   std::string s;
   if (!m.SerializeToString(&s)) {
@@ -9,34 +9,15 @@
 
 #include <string>
 
-#include <leveldb/comparator.h>
-#include <leveldb/db.h>
-
 #include "proto/paxos.pb.h"
+#include "storage/log_storage.h"
 #include "storage/write_batch.h"
+#include "util/mutex.h"
 
 namespace skywalker {
 
 class Config;
 
-struct WriteOptions {
-  bool sync;
-
-  WriteOptions() : sync(true) {}
-};
-
-class Comparator : public leveldb::Comparator {
- public:
-  virtual int Compare(const leveldb::Slice& a, const leveldb::Slice& b) const;
-
-  virtual const char* Name() const { return "SkyWalker Comparator"; }
-
-  virtual void FindShortestSeparator(std::string* start,
-                                     const leveldb::Slice& limit) const {}
-
-  virtual void FindShortSuccessor(std::string* key) const {}
-};
-
 class DB {
  public:
   explicit DB(Config* config);
@@ -51,13 +32,39 @@ class DB {
 
   int Write(const WriteOptions& options, WriteBatch* updates);
 
+  // Writes the updates of the chosen instances before end, such as the
+  // learned records and the deletions of the old log.
+  int WriteChosen(const WriteOptions& options, WriteBatch* updates,
+                  uint64_t end);
+
+  // Writes the accepted records, but drops the ones of the instances which
+  // have been written by WriteChosen(), so a late group commit can't
+  // overwrite the chosen values or bring back the deleted log.
+  int WriteAccepted(const WriteOptions& options, WriteBatch* updates);
+
+  // Writes the accepted records replayed from the log of group commit,
+  // which may have been written before. The records of the deleted log and
+  // the ones which aren't newer than the written ones are dropped.
+  int WriteReplayed(WriteBatch* updates);
+
+  // Makes the earlier writes durable.
+  int Sync();
+
   int Get(uint64_t instance_id, std::string* value);
 
   int GetMaxInstanceId(uint64_t* instance_id);
 
+  // Caller should delete the iterator when it is no longer needed.
+  LogIterator* NewIterator();
+
   int SetMinChosenInstanceId(uint64_t id);
   int GetMinChosenInstanceId(uint64_t* id);
 
+  // Adds the max chosen instance_id to the updates, so it's written
+  // together with the records instead of one more write.
+  void SetMaxChosenInstanceId(uint64_t id, WriteBatch* updates);
+  int GetMaxChosenInstanceId(uint64_t* id);
+
   int SetMembership(const Membership& v);
   int GetMembership(Membership* v);
 
@@ -66,8 +73,15 @@ class DB {
 
  private:
   Config* config_;
-  leveldb::DB* db_;
-  Comparator comparator_;
+  LogStorage* storage_;
+
+  void DropStale(WriteBatch* updates, bool accepted);
+  void UpdateMaxChosen(const WriteBatch& updates);
+
+  // Orders WriteChosen() and WriteAccepted().
+  Mutex mutex_;
+  uint64_t chosen_end_;
+  uint64_t max_chosen_id_;
 
   // No copying allowed
   DB(const DB&);
@@ -0,0 +1,200 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "storage/group_commit.h"
+
+#include <assert.h>
+#include <memory>
+#include <utility>
+
+#include "skywalker/logging.h"
+#include "storage/db.h"
+#include "storage/write_batch.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+
+namespace skywalker {
+
+namespace {
+static const uint64_t kSegmentSize = 64 * 1024 * 1024;
+static const uint64_t kTrimSize = 16 * 1024 * 1024;
+}  // namespace
+
+// A record of the shared log is the writes of a commit, its key is the
+// sequence of the commit and its value is:
+//    count times:
+//      group_id: uint32
+//      updates:  WriteBatch
+GroupCommit::GroupCommit(uint64_t window)
+    : window_(window),
+      loop_(nullptr),
+      mutex_(),
+      scheduled_(false),
+      log_(kSegmentSize),
+      first_(0),
+      next_(0),
+      bytes_(0) {}
+
+GroupCommit::~GroupCommit() {}
+
+int GroupCommit::Open(const std::string& dir) {
+  if (log_.Open(dir) != 0) {
+    return -1;
+  }
+  std::unique_ptr<LogIterator> iter(log_.NewIterator());
+  iter->Seek(0);
+  if (iter->Valid()) {
+    first_ = iter->key();
+  }
+  for (; iter->Valid(); iter->Next()) {
+    Slice input(iter->value());
+    while (!input.empty()) {
+      if (input.size() < sizeof(uint32_t)) {
+        break;
+      }
+      uint32_t group_id = DecodeFixed32(input.data());
+      input.remove_prefix(sizeof(uint32_t));
+      std::vector<WriteBatch>& batches = replayed_[group_id];
+      batches.push_back(WriteBatch());
+      if (!batches.back().DecodeFrom(&input)) {
+        break;
+      }
+    }
+    if (!input.empty()) {
+      LOG_ERROR("GroupCommit::Open - the record %llu is corrupted.",
+                (unsigned long long)iter->key());
+      return -1;
+    }
+    next_ = iter->key() + 1;
+  }
+  return iter->status();
+}
+
+int GroupCommit::Replay(uint32_t group_id, DB* db) {
+  auto it = replayed_.find(group_id);
+  if (it == replayed_.end()) {
+    return 0;
+  }
+  for (auto& batch : it->second) {
+    if (db->WriteReplayed(&batch) != 0) {
+      LOG_ERROR("Group %u - replay the log of group commit failed.",
+                group_id);
+      return -1;
+    }
+  }
+  MutexLock lock(&mutex_);
+  dbs_.insert(db);
+  return 0;
+}
+
+int GroupCommit::EndReplay() {
+  replayed_.clear();
+  return Trim();
+}
+
+void GroupCommit::Start() {
+  assert(loop_ == nullptr);
+  loop_ = thread_.Loop();
+}
+
+void GroupCommit::Write(uint32_t group_id, DB* db, WriteBatch* updates,
+                        RunLoop* loop, const CommitCallback& cb) {
+  MutexLock lock(&mutex_);
+  requests_.push_back(Request());
+  Request& r = requests_.back();
+  r.group_id = group_id;
+  r.db = db;
+  r.updates.Swap(updates);
+  r.loop = loop;
+  r.cb = cb;
+  if (!scheduled_) {
+    scheduled_ = true;
+    if (window_ > 0) {
+      loop_->RunAfter(window_, [this]() { Commit(); });
+    } else {
+      loop_->QueueInLoop([this]() { Commit(); });
+    }
+  }
+}
+
+void GroupCommit::Commit() {
+  std::vector<Request> requests;
+  {
+    MutexLock lock(&mutex_);
+    requests.swap(requests_);
+    scheduled_ = false;
+  }
+
+  std::map<DB*, std::pair<uint32_t, std::unique_ptr<WriteBatch>>> batches;
+  for (auto& r : requests) {
+    auto& b = batches[r.db];
+    if (!b.second) {
+      b.first = r.group_id;
+      b.second.reset(new WriteBatch());
+    }
+    b.second->Append(r.updates);
+  }
+
+  // Only the shared log is synced, the dbs are synced when it's trimmed.
+  std::string record;
+  for (auto& b : batches) {
+    PutFixed32(&record, b.second.first);
+    b.second.second->EncodeTo(&record);
+  }
+  WriteOptions options;
+  options.sync = true;
+  bool ok = (log_.Put(options, next_, record) == 0);
+  if (ok) {
+    ++next_;
+    bytes_ += record.size();
+  } else {
+    LOG_ERROR("GroupCommit::Commit - write the shared log failed.");
+  }
+
+  std::map<DB*, bool> results;
+  options.sync = false;
+  for (auto& b : batches) {
+    results[b.first] =
+        ok && b.first->WriteAccepted(options, b.second.second.get()) == 0;
+    dbs_.insert(b.first);
+  }
+
+  for (auto& r : requests) {
+    r.loop->QueueInLoop(std::bind(r.cb, results[r.db]));
+  }
+
+  if (bytes_ >= kTrimSize) {
+    Trim();
+  }
+}
+
+// The records are deleted after the dbs have been synced, the deletions
+// needn't be synced since the records can be replayed again.
+int GroupCommit::Trim() {
+  for (DB* db : dbs_) {
+    if (db->Sync() != 0) {
+      LOG_ERROR("GroupCommit::Trim - sync the db failed.");
+      return -1;
+    }
+  }
+  dbs_.clear();
+  if (first_ == next_) {
+    return 0;
+  }
+  WriteBatch batch;
+  for (uint64_t i = first_; i < next_; ++i) {
+    batch.Delete(i);
+  }
+  WriteOptions options;
+  options.sync = false;
+  if (log_.Write(options, &batch) != 0) {
+    LOG_ERROR("GroupCommit::Trim - trim the shared log failed.");
+    return -1;
+  }
+  first_ = next_;
+  bytes_ = 0;
+  return 0;
+}
+
+}  // namespace skywalker
@@ -0,0 +1,97 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_STORAGE_GROUP_COMMIT_H_
+#define SKYWALKER_STORAGE_GROUP_COMMIT_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "storage/segment_storage.h"
+#include "storage/write_batch.h"
+#include "util/mutex.h"
+#include "util/runloop.h"
+#include "util/runloop_thread.h"
+
+namespace skywalker {
+
+class DB;
+
+typedef std::function<void(bool)> CommitCallback;
+
+// Collects the writes of all groups on a node in a short window, and
+// appends them to one log shared by the groups with one sync, so all the
+// groups share one fsync instead of issuing one for each write or each db.
+// Then they are written into the dbs without syncing. When the shared log
+// has grown by a few megabytes, the dbs are synced and the log is trimmed.
+// The records left in the log after a crash are written into the dbs again
+// before the groups recover. The writes are the accepted records, they go
+// through DB::WriteAccepted() to keep the order with the chosen ones.
+class GroupCommit {
+ public:
+  explicit GroupCommit(uint64_t window);
+  ~GroupCommit();
+
+  // Opens the shared log in the dir and reads the records left in it.
+  int Open(const std::string& dir);
+
+  // Writes the records of the group left in the shared log into its db,
+  // it's called by the groups concurrently when they recover.
+  int Replay(uint32_t group_id, DB* db);
+
+  // Syncs the replayed dbs and trims the shared log.
+  int EndReplay();
+
+  void Start();
+
+  // The updates are moved into the committer. The cb will be run in the
+  // loop after they are durable or the write failed.
+  void Write(uint32_t group_id, DB* db, WriteBatch* updates, RunLoop* loop,
+             const CommitCallback& cb);
+
+ private:
+  struct Request {
+    uint32_t group_id;
+    DB* db;
+    WriteBatch updates;
+    RunLoop* loop;
+    CommitCallback cb;
+  };
+
+  void Commit();
+  int Trim();
+
+  const uint64_t window_;
+  RunLoopThread thread_;
+  RunLoop* loop_;
+
+  Mutex mutex_;
+  bool scheduled_;
+  std::vector<Request> requests_;
+
+  // Used in the committer loop, or before it starts.
+  SegmentStorage log_;
+  // The keys of the shared log in [first_, next_) haven't been trimmed.
+  uint64_t first_;
+  uint64_t next_;
+  uint64_t bytes_;
+  // The dbs written since the last trim.
+  std::set<DB*> dbs_;
+
+  // The records read from the shared log, by the group_id.
+  std::map<uint32_t, std::vector<WriteBatch>> replayed_;
+
+  // No copying allowed
+  GroupCommit(const GroupCommit&);
+  void operator=(const GroupCommit&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_STORAGE_GROUP_COMMIT_H_
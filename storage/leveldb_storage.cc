@@ -0,0 +1,195 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "storage/leveldb_storage.h"
+
+#include <leveldb/iterator.h>
+#include <leveldb/options.h>
+#include <leveldb/status.h>
+#include <leveldb/write_batch.h>
+
+#include "skywalker/logging.h"
+#include "util/coding.h"
+
+namespace skywalker {
+
+namespace {
+
+class LevelDBIterator : public LogIterator {
+ public:
+  explicit LevelDBIterator(leveldb::Iterator* iter) : iter_(iter) {}
+  virtual ~LevelDBIterator() { delete iter_; }
+
+  virtual void Seek(uint64_t target) {
+    char buf[sizeof(target)];
+    EncodeFixed64(buf, target);
+    iter_->Seek(leveldb::Slice(buf, sizeof(buf)));
+  }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+
+  virtual void Next() { iter_->Next(); }
+
+  virtual uint64_t key() const { return DecodeFixed64(iter_->key().data()); }
+
+  virtual Slice value() const {
+    leveldb::Slice v = iter_->value();
+    return Slice(v.data(), v.size());
+  }
+
+  virtual int status() const {
+    leveldb::Status status = iter_->status();
+    if (!status.ok()) {
+      LOG_ERROR("LevelDBIterator - %s", status.ToString().c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+ private:
+  leveldb::Iterator* iter_;
+};
+
+}  // namespace
+
+int Comparator::Compare(const leveldb::Slice& a,
+                        const leveldb::Slice& b) const {
+  uint64_t key = DecodeFixed64(a.data());
+  uint64_t key2 = DecodeFixed64(b.data());
+  if (key == key2) {
+    return 0;
+  }
+  return key > key2 ? 1 : -1;
+}
+
+LevelDBStorage::LevelDBStorage(size_t write_buffer_size)
+    : write_buffer_size_(write_buffer_size), db_(nullptr) {}
+
+LevelDBStorage::~LevelDBStorage() { delete db_; }
+
+int LevelDBStorage::Open(const std::string& name) {
+  leveldb::Options options;
+  options.comparator = &comparator_;
+  options.create_if_missing = true;
+  options.write_buffer_size = write_buffer_size_;
+  leveldb::Status status = leveldb::DB::Open(options, name, &db_);
+  if (!status.ok()) {
+    LOG_ERROR("LevelDBStorage::Open - %s", status.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int LevelDBStorage::Put(const WriteOptions& options, uint64_t key,
+                        const std::string& value) {
+  char buf[sizeof(key)];
+  EncodeFixed64(buf, key);
+  leveldb::WriteOptions op;
+  op.sync = options.sync;
+  leveldb::Status status =
+      db_->Put(op, leveldb::Slice(buf, sizeof(buf)), value);
+  if (!status.ok()) {
+    LOG_ERROR("LevelDBStorage::Put - %s", status.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int LevelDBStorage::Delete(const WriteOptions& options, uint64_t key) {
+  char buf[sizeof(key)];
+  EncodeFixed64(buf, key);
+  leveldb::WriteOptions op;
+  op.sync = options.sync;
+  leveldb::Status status = db_->Delete(op, leveldb::Slice(buf, sizeof(buf)));
+  if (!status.ok()) {
+    LOG_ERROR("LevelDBStorage::Delete - %s", status.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int LevelDBStorage::Write(const WriteOptions& options, WriteBatch* updates) {
+  leveldb::WriteBatch batch;
+  char buf[sizeof(uint64_t)];
+  for (auto& op : updates->ops_) {
+    EncodeFixed64(buf, op.instance_id);
+    if (op.deleted) {
+      batch.Delete(leveldb::Slice(buf, sizeof(buf)));
+    } else {
+      batch.Put(leveldb::Slice(buf, sizeof(buf)), op.value);
+    }
+  }
+  leveldb::WriteOptions op;
+  op.sync = options.sync;
+  leveldb::Status status = db_->Write(op, &batch);
+  if (!status.ok()) {
+    LOG_ERROR("LevelDBStorage::Write - %s", status.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int LevelDBStorage::Get(uint64_t key, std::string* value) {
+  char buf[sizeof(key)];
+  EncodeFixed64(buf, key);
+  leveldb::Status status =
+      db_->Get(leveldb::ReadOptions(), leveldb::Slice(buf, sizeof(buf)), value);
+  int ret = 0;
+  if (!status.ok()) {
+    if (status.IsNotFound()) {
+      ret = 1;
+    } else {
+      ret = -1;
+      LOG_ERROR("LevelDBStorage::Get - %s", status.ToString().c_str());
+    }
+  }
+  return ret;
+}
+
+int LevelDBStorage::GetMaxKey(uint64_t limit, uint64_t* key) {
+  char buf[sizeof(limit)];
+  EncodeFixed64(buf, limit);
+  leveldb::Iterator* it = db_->NewIterator(leveldb::ReadOptions());
+  it->Seek(leveldb::Slice(buf, sizeof(buf)));
+  if (it->Valid()) {
+    it->Prev();
+  } else {
+    it->SeekToLast();
+  }
+  int ret = 1;
+  if (it->Valid()) {
+    *key = DecodeFixed64(it->key().data());
+    ret = 0;
+  } else if (!it->status().ok()) {
+    LOG_ERROR("LevelDBStorage::GetMaxKey - %s",
+              it->status().ToString().c_str());
+    ret = -1;
+  }
+  delete it;
+  return ret;
+}
+
+// A sync write syncs the earlier writes in the leveldb log, even if it's
+// empty.
+int LevelDBStorage::Sync() {
+  leveldb::WriteBatch batch;
+  leveldb::WriteOptions op;
+  op.sync = true;
+  leveldb::Status status = db_->Write(op, &batch);
+  if (!status.ok()) {
+    LOG_ERROR("LevelDBStorage::Sync - %s", status.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
+
+LogIterator* LevelDBStorage::NewIterator() {
+  // The blocks are read only once by the sequential reads, so don't let
+  // them push the hot blocks out of the cache.
+  leveldb::ReadOptions options;
+  options.fill_cache = false;
+  return new LevelDBIterator(db_->NewIterator(options));
+}
+
+}  // namespace skywalker
@@ -0,0 +1,65 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_STORAGE_LEVELDB_STORAGE_H_
+#define SKYWALKER_STORAGE_LEVELDB_STORAGE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include <leveldb/comparator.h>
+#include <leveldb/db.h>
+
+#include "storage/log_storage.h"
+
+namespace skywalker {
+
+class Comparator : public leveldb::Comparator {
+ public:
+  virtual int Compare(const leveldb::Slice& a, const leveldb::Slice& b) const;
+
+  virtual const char* Name() const { return "SkyWalker Comparator"; }
+
+  virtual void FindShortestSeparator(std::string* start,
+                                     const leveldb::Slice& limit) const {}
+
+  virtual void FindShortSuccessor(std::string* key) const {}
+};
+
+class LevelDBStorage : public LogStorage {
+ public:
+  explicit LevelDBStorage(size_t write_buffer_size);
+  virtual ~LevelDBStorage();
+
+  virtual int Open(const std::string& name);
+
+  virtual int Put(const WriteOptions& options, uint64_t key,
+                  const std::string& value);
+
+  virtual int Delete(const WriteOptions& options, uint64_t key);
+
+  virtual int Write(const WriteOptions& options, WriteBatch* updates);
+
+  virtual int Get(uint64_t key, std::string* value);
+
+  virtual int GetMaxKey(uint64_t limit, uint64_t* key);
+
+  virtual int Sync();
+
+  virtual LogIterator* NewIterator();
+
+ private:
+  const size_t write_buffer_size_;
+  leveldb::DB* db_;
+  Comparator comparator_;
+
+  // No copying allowed
+  LevelDBStorage(const LevelDBStorage&);
+  void operator=(const LevelDBStorage&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_STORAGE_LEVELDB_STORAGE_H_
@@ -0,0 +1,92 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_STORAGE_LOG_STORAGE_H_
+#define SKYWALKER_STORAGE_LOG_STORAGE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "skywalker/slice.h"
+#include "storage/write_batch.h"
+
+namespace skywalker {
+
+struct WriteOptions {
+  bool sync;
+
+  WriteOptions() : sync(true) {}
+};
+
+// An iterator over the records of a LogStorage by the key order, which
+// reads ahead for the sequential reads. It isn't safe for concurrent
+// access, but the storage may be written while iterating.
+class LogIterator {
+ public:
+  LogIterator() {}
+  virtual ~LogIterator() {}
+
+  // Position at the first record whose key is at or past target.
+  virtual void Seek(uint64_t target) = 0;
+
+  virtual bool Valid() const = 0;
+
+  // REQUIRES: Valid()
+  virtual void Next() = 0;
+
+  // REQUIRES: Valid()
+  virtual uint64_t key() const = 0;
+
+  // The returned slice is valid until the next modification of the iterator.
+  // REQUIRES: Valid()
+  virtual Slice value() const = 0;
+
+  // Returns 0 if ok and -1 if error.
+  virtual int status() const = 0;
+
+ private:
+  // No copying allowed
+  LogIterator(const LogIterator&);
+  void operator=(const LogIterator&);
+};
+
+// The storage engine of the paxos log, whose keys are the instance ids.
+// All the methods return 0 if ok, 1 if not found and -1 if error.
+// The methods may be called by multiple threads at the same time.
+class LogStorage {
+ public:
+  LogStorage() {}
+  virtual ~LogStorage() {}
+
+  virtual int Open(const std::string& name) = 0;
+
+  virtual int Put(const WriteOptions& options, uint64_t key,
+                  const std::string& value) = 0;
+
+  virtual int Delete(const WriteOptions& options, uint64_t key) = 0;
+
+  virtual int Write(const WriteOptions& options, WriteBatch* updates) = 0;
+
+  virtual int Get(uint64_t key, std::string* value) = 0;
+
+  // Store the max key which is less than limit in *key.
+  virtual int GetMaxKey(uint64_t limit, uint64_t* key) = 0;
+
+  // Makes the earlier writes durable.
+  virtual int Sync() = 0;
+
+  // Returns a heap-allocated iterator over the storage.
+  // Caller should delete the iterator when it is no longer needed.
+  virtual LogIterator* NewIterator() = 0;
+
+ private:
+  // No copying allowed
+  LogStorage(const LogStorage&);
+  void operator=(const LogStorage&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_STORAGE_LOG_STORAGE_H_
@@ -0,0 +1,509 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "storage/segment_storage.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "skywalker/file.h"
+#include "skywalker/logging.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace skywalker {
+
+namespace {
+
+enum RecordType { kPutRecord = 1, kDeleteRecord = 2 };
+
+// checksum (4 bytes) + length (4 bytes)
+static const uint32_t kHeaderSize = 8;
+
+// type (1 byte) + key (8 bytes)
+static const uint32_t kMinLength = 9;
+
+// The live records of the oldest segment are moved to the current segment
+// when there are only a few of them, such as the membership and the master
+// state which are rarely rewritten, so that the segment can be deleted.
+static const uint64_t kMaxRelocateCount = 8;
+
+// The iterator reads about so many bytes of the records at a time.
+static const uint64_t kReadAheadSize = 1024 * 1024;
+
+}  // namespace
+
+class SegmentIterator : public LogIterator {
+ public:
+  explicit SegmentIterator(SegmentStorage* storage)
+      : storage_(storage), pos_(0), status_(0) {}
+
+  virtual void Seek(uint64_t target) { Fill(target); }
+
+  virtual bool Valid() const {
+    return status_ == 0 && pos_ < records_.size();
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    if (++pos_ == records_.size()) {
+      uint64_t last = records_.back().key;
+      if (last == UINT64_MAX) {
+        records_.clear();
+        pos_ = 0;
+      } else {
+        Fill(last + 1);
+      }
+    }
+  }
+
+  virtual uint64_t key() const { return records_[pos_].key; }
+
+  virtual Slice value() const { return Slice(records_[pos_].value); }
+
+  virtual int status() const { return status_; }
+
+ private:
+  void Fill(uint64_t target) {
+    pos_ = 0;
+    status_ = storage_->ReadAhead(target, &records_);
+  }
+
+  SegmentStorage* storage_;
+  std::vector<SegmentStorage::Record> records_;
+  size_t pos_;
+  int status_;
+};
+
+SegmentStorage::SegmentStorage(uint64_t segment_size)
+    : segment_size_(segment_size), mutex_(), current_(0) {}
+
+SegmentStorage::~SegmentStorage() {}
+
+SegmentStorage::SegmentFile::~SegmentFile() { close(fd); }
+
+int SegmentStorage::Open(const std::string& name) {
+  dir_ = name;
+  FileManager::Instance()->CreateDir(dir_);
+
+  std::vector<std::string> files;
+  Status s = FileManager::Instance()->GetChildren(dir_, &files, true);
+  if (!s.ok()) {
+    LOG_ERROR("SegmentStorage::Open - %s", s.ToString().c_str());
+    return -1;
+  }
+
+  std::vector<uint64_t> numbers;
+  for (auto& f : files) {
+    unsigned long long number;
+    char suffix[8];
+    if (sscanf(f.c_str(), "%llu.%7s", &number, suffix) == 2 &&
+        strcmp(suffix, "seg") == 0) {
+      numbers.push_back(static_cast<uint64_t>(number));
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  MutexLock lock(&mutex_);
+  for (size_t i = 0; i < numbers.size(); ++i) {
+    if (LoadSegment(numbers[i], i + 1 == numbers.size()) != 0) {
+      return -1;
+    }
+  }
+  // Always write a new segment, so the bad tail of the last segment
+  // which may be left by a crash will never be appended.
+  if (NewSegment(numbers.empty() ? 1 : numbers.back() + 1) != 0) {
+    return -1;
+  }
+  RemoveSegments();
+  return 0;
+}
+
+int SegmentStorage::Put(const WriteOptions& options, uint64_t key,
+                        const std::string& value) {
+  WriteBatch batch;
+  batch.Put(key, value);
+  return Write(options, &batch);
+}
+
+int SegmentStorage::Delete(const WriteOptions& options, uint64_t key) {
+  WriteBatch batch;
+  batch.Delete(key);
+  return Write(options, &batch);
+}
+
+int SegmentStorage::Write(const WriteOptions& options, WriteBatch* updates) {
+  MutexLock lock(&mutex_);
+  if (updates->Count() == 0) {
+    return 0;
+  }
+  int ret = Append(*updates, options.sync);
+  if (ret == 0) {
+    RemoveSegments();
+  }
+  return ret;
+}
+
+int SegmentStorage::Get(uint64_t key, std::string* value) {
+  Location l;
+  std::shared_ptr<SegmentFile> file;
+  {
+    MutexLock lock(&mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return 1;
+    }
+    l = it->second;
+    file = segments_[l.segment].file;
+  }
+  return ReadRecord(*file, l, value);
+}
+
+int SegmentStorage::GetMaxKey(uint64_t limit, uint64_t* key) {
+  MutexLock lock(&mutex_);
+  auto it = index_.lower_bound(limit);
+  if (it == index_.begin()) {
+    return 1;
+  }
+  --it;
+  *key = it->first;
+  return 0;
+}
+
+// The older segments have been synced when the current one was created.
+int SegmentStorage::Sync() {
+  MutexLock lock(&mutex_);
+  Segment& seg = segments_[current_];
+  if (fdatasync(seg.file->fd) != 0) {
+    LOG_ERROR("SegmentStorage::Sync - %s: %s",
+              SegmentFileName(current_).c_str(), strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+LogIterator* SegmentStorage::NewIterator() {
+  return new SegmentIterator(this);
+}
+
+std::string SegmentStorage::SegmentFileName(uint64_t number) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%020llu.seg", (unsigned long long)number);
+  return dir_ + name;
+}
+
+// Only the last segment may have a bad tail, which is left by a crash in
+// the middle of an append, since a segment is synced before the next one
+// is created. The tail is cut off so that it is never loaded again.
+int SegmentStorage::LoadSegment(uint64_t number, bool last) {
+  std::string fname = SegmentFileName(number);
+  std::string data;
+  Status s = ReadFileToString(FileManager::Instance(), fname, &data);
+  if (!s.ok()) {
+    LOG_ERROR("SegmentStorage::LoadSegment - %s", s.ToString().c_str());
+    return -1;
+  }
+  int fd = open(fname.c_str(), last ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    LOG_ERROR("SegmentStorage::LoadSegment - %s: %s", fname.c_str(),
+              strerror(errno));
+    return -1;
+  }
+
+  Segment& seg = segments_[number];
+  seg.file = std::make_shared<SegmentFile>(fd);
+  seg.size = 0;
+  seg.live = 0;
+
+  uint64_t pos = 0;
+  while (pos + kHeaderSize <= data.size()) {
+    const char* p = data.data() + pos;
+    uint32_t crc = DecodeFixed32(p);
+    uint32_t length = DecodeFixed32(p + 4);
+    if (length < kMinLength || pos + kHeaderSize + length > data.size() ||
+        crc32c::Value(p + kHeaderSize, length) != crc) {
+      break;
+    }
+    Location l;
+    l.segment = number;
+    l.offset = pos;
+    l.size = kHeaderSize + length;
+    Apply(p[kHeaderSize] == kDeleteRecord,
+          DecodeFixed64(p + kHeaderSize + 1), l);
+    pos += l.size;
+  }
+  if (pos < data.size()) {
+    if (!last) {
+      LOG_ERROR("SegmentStorage::LoadSegment - %s has a bad record at %llu.",
+                fname.c_str(), (unsigned long long)pos);
+      return -1;
+    }
+    LOG_WARN("SegmentStorage - %s has a bad tail at %llu, cut it off.",
+             fname.c_str(), (unsigned long long)pos);
+    if (ftruncate(fd, static_cast<off_t>(pos)) != 0 || fdatasync(fd) != 0) {
+      LOG_ERROR("SegmentStorage::LoadSegment - %s: %s", fname.c_str(),
+                strerror(errno));
+      return -1;
+    }
+  }
+  seg.size = pos;
+  return 0;
+}
+
+int SegmentStorage::NewSegment(uint64_t number) {
+  std::string fname = SegmentFileName(number);
+  int fd = open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG_ERROR("SegmentStorage::NewSegment - %s: %s", fname.c_str(),
+              strerror(errno));
+    return -1;
+  }
+  Segment& seg = segments_[number];
+  seg.file = std::make_shared<SegmentFile>(fd);
+  seg.size = 0;
+  seg.live = 0;
+  current_ = number;
+  return SyncDir();
+}
+
+// The directory is synced whenever a segment is created or removed, so
+// the segments found when recovering are the ones which have been used.
+int SegmentStorage::SyncDir() {
+  int fd = open(dir_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG_ERROR("SegmentStorage::SyncDir - %s: %s", dir_.c_str(),
+              strerror(errno));
+    return -1;
+  }
+  int ret = fsync(fd);
+  if (ret != 0) {
+    LOG_ERROR("SegmentStorage::SyncDir - %s: %s", dir_.c_str(),
+              strerror(errno));
+  }
+  close(fd);
+  return ret == 0 ? 0 : -1;
+}
+
+int SegmentStorage::Append(const WriteBatch& batch, bool sync) {
+  std::string buf;
+  std::vector<uint64_t> offsets;
+  offsets.reserve(batch.ops_.size());
+  for (auto& op : batch.ops_) {
+    offsets.push_back(buf.size());
+    size_t start = buf.size();
+    uint32_t length =
+        kMinLength + static_cast<uint32_t>(op.deleted ? 0 : op.value.size());
+    PutFixed32(&buf, 0);
+    PutFixed32(&buf, length);
+    buf.push_back(static_cast<char>(op.deleted ? kDeleteRecord : kPutRecord));
+    PutFixed64(&buf, op.instance_id);
+    if (!op.deleted) {
+      buf.append(op.value);
+    }
+    EncodeFixed32(&buf[start],
+                  crc32c::Value(buf.data() + start + kHeaderSize, length));
+  }
+
+  // A batch is never split into two segments.
+  Segment* seg = &segments_[current_];
+  if (seg->size > 0 && seg->size + buf.size() > segment_size_) {
+    if (fdatasync(seg->file->fd) != 0) {
+      LOG_ERROR("SegmentStorage::Append - %s: %s",
+                SegmentFileName(current_).c_str(), strerror(errno));
+      return -1;
+    }
+    if (NewSegment(current_ + 1) != 0) {
+      return -1;
+    }
+    seg = &segments_[current_];
+  }
+
+  size_t written = 0;
+  while (written < buf.size()) {
+    ssize_t r = pwrite(seg->file->fd, buf.data() + written, buf.size() - written,
+                       static_cast<off_t>(seg->size + written));
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR("SegmentStorage::Append - %s: %s",
+                SegmentFileName(current_).c_str(), strerror(errno));
+      return -1;
+    }
+    written += static_cast<size_t>(r);
+  }
+  if (sync && fdatasync(seg->file->fd) != 0) {
+    LOG_ERROR("SegmentStorage::Append - %s: %s",
+              SegmentFileName(current_).c_str(), strerror(errno));
+    return -1;
+  }
+
+  uint64_t base = seg->size;
+  seg->size += buf.size();
+  for (size_t i = 0; i < batch.ops_.size(); ++i) {
+    Location l;
+    l.segment = current_;
+    l.offset = base + offsets[i];
+    l.size = static_cast<uint32_t>(
+        (i + 1 < offsets.size() ? offsets[i + 1] : buf.size()) - offsets[i]);
+    Apply(batch.ops_[i].deleted, batch.ops_[i].instance_id, l);
+  }
+  return 0;
+}
+
+int SegmentStorage::ReadRecord(const SegmentFile& file, const Location& l,
+                               std::string* value) {
+  std::string buf(l.size, '\0');
+  if (Read(file, l.segment, l.offset, l.size, &buf[0]) != 0) {
+    return -1;
+  }
+  return DecodeRecord(l, buf.data(), value);
+}
+
+// Read the records from the first key at or past from, until about
+// kReadAheadSize bytes. The records which are adjacent in a segment,
+// as the log is mostly appended by the key order, are read together.
+// The files are read after the mutex is released, so the appends don't
+// wait for them.
+int SegmentStorage::ReadAhead(uint64_t from, std::vector<Record>* records) {
+  records->clear();
+  std::vector<std::pair<uint64_t, Location>> locations;
+  std::map<uint64_t, std::shared_ptr<SegmentFile>> files;
+  {
+    MutexLock lock(&mutex_);
+    uint64_t bytes = 0;
+    for (auto it = index_.lower_bound(from);
+         it != index_.end() && bytes < kReadAheadSize; ++it) {
+      locations.push_back(*it);
+      bytes += it->second.size;
+      if (files.find(it->second.segment) == files.end()) {
+        files[it->second.segment] = segments_[it->second.segment].file;
+      }
+    }
+  }
+
+  std::string buf;
+  size_t i = 0;
+  while (i < locations.size()) {
+    const Location& first = locations[i].second;
+    uint64_t end = first.offset + first.size;
+    size_t j = i + 1;
+    while (j < locations.size() &&
+           locations[j].second.segment == first.segment &&
+           locations[j].second.offset == end) {
+      end += locations[j].second.size;
+      ++j;
+    }
+    buf.resize(end - first.offset);
+    if (Read(*files[first.segment], first.segment, first.offset, buf.size(),
+             &buf[0]) != 0) {
+      return -1;
+    }
+    for (; i < j; ++i) {
+      const Location& l = locations[i].second;
+      records->push_back(Record());
+      records->back().key = locations[i].first;
+      if (DecodeRecord(l, buf.data() + (l.offset - first.offset),
+                       &records->back().value) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int SegmentStorage::Read(const SegmentFile& file, uint64_t segment,
+                         uint64_t offset, size_t n, char* buf) {
+  size_t done = 0;
+  while (done < n) {
+    ssize_t r = pread(file.fd, buf + done, n - done,
+                      static_cast<off_t>(offset + done));
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      LOG_ERROR("SegmentStorage::Read - %s: read failed.",
+                SegmentFileName(segment).c_str());
+      return -1;
+    }
+    done += static_cast<size_t>(r);
+  }
+  return 0;
+}
+
+int SegmentStorage::DecodeRecord(const Location& l, const char* p,
+                                 std::string* value) {
+  uint32_t length = DecodeFixed32(p + 4);
+  if (length + kHeaderSize != l.size ||
+      crc32c::Value(p + kHeaderSize, length) != DecodeFixed32(p)) {
+    LOG_ERROR("SegmentStorage::DecodeRecord - %s: checksum mismatch at %llu.",
+              SegmentFileName(l.segment).c_str(),
+              (unsigned long long)l.offset);
+    return -1;
+  }
+  value->assign(p + kHeaderSize + kMinLength, length - kMinLength);
+  return 0;
+}
+
+void SegmentStorage::Apply(bool deleted, uint64_t key, const Location& l) {
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    auto s = segments_.find(it->second.segment);
+    if (s != segments_.end()) {
+      --s->second.live;
+    }
+    if (deleted) {
+      index_.erase(it);
+    } else {
+      it->second = l;
+    }
+  } else if (!deleted) {
+    index_[key] = l;
+  }
+  if (!deleted) {
+    ++segments_[l.segment].live;
+  }
+}
+
+// Only the oldest segment can be deleted, otherwise the records in the
+// older segments which have been deleted will come back when recovering.
+void SegmentStorage::RemoveSegments() {
+  while (segments_.begin()->first != current_) {
+    auto it = segments_.begin();
+    if (it->second.live > kMaxRelocateCount) {
+      break;
+    }
+    if (it->second.live > 0) {
+      WriteBatch batch;
+      for (auto& i : index_) {
+        if (i.second.segment == it->first) {
+          std::string value;
+          if (ReadRecord(*it->second.file, i.second, &value) != 0) {
+            return;
+          }
+          batch.Put(i.first, value);
+        }
+      }
+      if (Append(batch, true) != 0) {
+        return;
+      }
+      assert(it->second.live == 0);
+    }
+    FileManager::Instance()->DeleteFile(SegmentFileName(it->first));
+    segments_.erase(it);
+    if (SyncDir() != 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace skywalker
@@ -0,0 +1,116 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_STORAGE_SEGMENT_STORAGE_H_
+#define SKYWALKER_STORAGE_SEGMENT_STORAGE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "storage/log_storage.h"
+#include "util/mutex.h"
+
+namespace skywalker {
+
+// An append-only storage made for the paxos log. The records are appended
+// to the segment files of fixed size, and an in-memory index maps every key
+// to its latest record. Since the log is deleted by the prefix, a segment
+// file is deleted as a whole when all the records in it and in the older
+// segments are dead.
+//
+// The record format is:
+//    checksum: uint32     // crc32c of type, key and value
+//    length:   uint32     // the length of type, key and value
+//    type:     uint8      // kPutRecord or kDeleteRecord
+//    key:      uint64
+//    value:    uint8[length - 9]
+class SegmentStorage : public LogStorage {
+ public:
+  explicit SegmentStorage(uint64_t segment_size);
+  virtual ~SegmentStorage();
+
+  virtual int Open(const std::string& name);
+
+  virtual int Put(const WriteOptions& options, uint64_t key,
+                  const std::string& value);
+
+  virtual int Delete(const WriteOptions& options, uint64_t key);
+
+  virtual int Write(const WriteOptions& options, WriteBatch* updates);
+
+  virtual int Get(uint64_t key, std::string* value);
+
+  virtual int GetMaxKey(uint64_t limit, uint64_t* key);
+
+  virtual int Sync();
+
+  virtual LogIterator* NewIterator();
+
+ private:
+  friend class SegmentIterator;
+
+  struct Location {
+    uint64_t segment;
+    uint64_t offset;
+    uint32_t size;
+  };
+
+  // The file is closed when its segment has been removed and no reader
+  // uses it anymore, so the records are read without holding the mutex.
+  struct SegmentFile {
+    explicit SegmentFile(int f) : fd(f) {}
+    ~SegmentFile();
+
+    const int fd;
+
+    // No copying allowed
+    SegmentFile(const SegmentFile&);
+    void operator=(const SegmentFile&);
+  };
+
+  struct Segment {
+    std::shared_ptr<SegmentFile> file;
+    uint64_t size;
+    uint64_t live;
+  };
+
+  struct Record {
+    uint64_t key;
+    std::string value;
+  };
+
+  std::string SegmentFileName(uint64_t number) const;
+  int LoadSegment(uint64_t number, bool last);
+  int NewSegment(uint64_t number);
+  int SyncDir();
+  int Append(const WriteBatch& batch, bool sync);
+  int ReadRecord(const SegmentFile& file, const Location& l,
+                 std::string* value);
+  int ReadAhead(uint64_t from, std::vector<Record>* records);
+  int Read(const SegmentFile& file, uint64_t segment, uint64_t offset,
+           size_t n, char* buf);
+  int DecodeRecord(const Location& l, const char* p, std::string* value);
+  void Apply(bool deleted, uint64_t key, const Location& l);
+  void RemoveSegments();
+
+  const uint64_t segment_size_;
+  std::string dir_;
+
+  Mutex mutex_;
+  uint64_t current_;
+  std::map<uint64_t, Segment> segments_;
+  std::map<uint64_t, Location> index_;
+
+  // No copying allowed
+  SegmentStorage(const SegmentStorage&);
+  void operator=(const SegmentStorage&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_STORAGE_SEGMENT_STORAGE_H_
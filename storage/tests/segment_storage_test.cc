@@ -0,0 +1,190 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "skywalker/file.h"
+#include "storage/segment_storage.h"
+#include "util/testharness.h"
+
+namespace skywalker {
+
+static std::string Value(uint64_t key) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "value-%llu", (unsigned long long)key);
+  return std::string(buf) + std::string(100, 'x');
+}
+
+static std::vector<std::string> Segments(const std::string& dir) {
+  std::vector<std::string> files;
+  CHECK(FileManager::Instance()->GetChildren(dir, &files, true).ok());
+  std::vector<std::string> result;
+  for (auto& f : files) {
+    if (f.size() > 4 && f.compare(f.size() - 4, 4, ".seg") == 0) {
+      result.push_back(dir + "/" + f);
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// A new directory for a test, which is removed with its segments.
+class TempDir {
+ public:
+  TempDir() {
+    char dir[] = "/tmp/segment_storage_test-XXXXXX";
+    CHECK(mkdtemp(dir) != nullptr);
+    path_ = dir;
+  }
+
+  ~TempDir() {
+    std::vector<std::string> files;
+    FileManager::Instance()->GetChildren(path_, &files, true);
+    for (auto& f : files) {
+      FileManager::Instance()->DeleteFile(path_ + "/" + f);
+    }
+    FileManager::Instance()->DeleteDir(path_);
+  }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+static void CheckRange(SegmentStorage* storage, uint64_t from, uint64_t to) {
+  for (uint64_t i = from; i < to; ++i) {
+    std::string value;
+    CHECK(storage->Get(i, &value) == 0);
+    CHECK(value == Value(i));
+  }
+  std::unique_ptr<LogIterator> it(storage->NewIterator());
+  uint64_t i = from;
+  for (it->Seek(0); it->Valid(); it->Next()) {
+    CHECK(it->key() == i);
+    CHECK(it->value().ToString() == Value(i));
+    ++i;
+  }
+  CHECK(it->status() == 0);
+  CHECK(i == to);
+}
+
+static void Fill(SegmentStorage* storage, uint64_t from, uint64_t to) {
+  WriteOptions options;
+  for (uint64_t i = from; i < to; ++i) {
+    CHECK(storage->Put(options, i, Value(i)) == 0);
+  }
+}
+
+TEST(SegmentStorageTest, Reopen) {
+  TempDir temp;
+  const std::string& dir = temp.path();
+  {
+    SegmentStorage storage(4096);
+    CHECK(storage.Open(dir) == 0);
+    Fill(&storage, 1, 200);
+    WriteOptions options;
+    CHECK(storage.Delete(options, 199) == 0);
+    CheckRange(&storage, 1, 199);
+
+    uint64_t key = 0;
+    CHECK(storage.GetMaxKey(100, &key) == 0 && key == 99);
+    CHECK(storage.GetMaxKey(1, &key) == 1);
+  }
+  CHECK(Segments(dir).size() > 2);
+
+  SegmentStorage storage(4096);
+  CHECK(storage.Open(dir) == 0);
+  CheckRange(&storage, 1, 199);
+  std::string value;
+  CHECK(storage.Get(199, &value) == 1);
+}
+
+TEST(SegmentStorageTest, RemoveSegments) {
+  TempDir temp;
+  const std::string& dir = temp.path();
+  {
+    SegmentStorage storage(4096);
+    CHECK(storage.Open(dir) == 0);
+    Fill(&storage, 1, 300);
+    size_t before = Segments(dir).size();
+
+    WriteBatch batch;
+    for (uint64_t i = 1; i < 250; ++i) {
+      batch.Delete(i);
+    }
+    WriteOptions options;
+    CHECK(storage.Write(options, &batch) == 0);
+    // Rewrite the rest, so the older segments are dead except for a few
+    // records which are moved into the current segment.
+    Fill(&storage, 250, 300);
+    CHECK(Segments(dir).size() < before);
+    CheckRange(&storage, 250, 300);
+  }
+
+  SegmentStorage storage(4096);
+  CHECK(storage.Open(dir) == 0);
+  CheckRange(&storage, 250, 300);
+}
+
+TEST(SegmentStorageTest, BadTail) {
+  TempDir temp;
+  const std::string& dir = temp.path();
+  {
+    SegmentStorage storage(4096);
+    CHECK(storage.Open(dir) == 0);
+    Fill(&storage, 1, 100);
+  }
+  // A crash in the middle of an append leaves a part of a record.
+  std::vector<std::string> segments = Segments(dir);
+  std::string data;
+  CHECK(ReadFileToString(FileManager::Instance(), segments.back(), &data)
+            .ok());
+  data.append("\x12\x34\x56\x78\x40\x00\x00\x00\x01", 9);
+  CHECK(WriteStringToFile(FileManager::Instance(), data, segments.back())
+            .ok());
+
+  {
+    SegmentStorage storage(4096);
+    CHECK(storage.Open(dir) == 0);
+    CheckRange(&storage, 1, 100);
+    Fill(&storage, 100, 120);
+  }
+  // The tail has been cut off, so the segment is fine when it isn't the
+  // last one anymore.
+  SegmentStorage storage(4096);
+  CHECK(storage.Open(dir) == 0);
+  CheckRange(&storage, 1, 120);
+}
+
+TEST(SegmentStorageTest, Corruption) {
+  TempDir temp;
+  const std::string& dir = temp.path();
+  {
+    SegmentStorage storage(4096);
+    CHECK(storage.Open(dir) == 0);
+    Fill(&storage, 1, 100);
+  }
+  std::vector<std::string> segments = Segments(dir);
+  CHECK(segments.size() > 2);
+  std::string data;
+  CHECK(ReadFileToString(FileManager::Instance(), segments.front(), &data)
+            .ok());
+  data[data.size() / 2] ^= 0x01;
+  CHECK(WriteStringToFile(FileManager::Instance(), data, segments.front())
+            .ok());
+
+  SegmentStorage storage(4096);
+  CHECK(storage.Open(dir) != 0);
+}
+
+}  // namespace skywalker
+
+int main() { return skywalker::test::RunAllTests(); }
@@ -3,26 +3,78 @@
 // found in the LICENSE file.
 
 #include "storage/write_batch.h"
+
 #include "util/coding.h"
 
 namespace skywalker {
 
-WriteBatch::WriteBatch() : batch_(new leveldb::WriteBatch()) {}
+// The encoding is:
+//    count:    uint32
+//    count times:
+//      deleted:  uint8
+//      key:      uint64
+//      length:   uint32    // 0 if deleted
+//      value:    uint8[length]
+
+WriteBatch::WriteBatch() {}
 
-WriteBatch::~WriteBatch() { delete batch_; }
+WriteBatch::~WriteBatch() {}
 
 void WriteBatch::Put(uint64_t instance_id, const std::string& value) {
-  char key[sizeof(instance_id)];
-  EncodeFixed64(key, instance_id);
-  batch_->Put(leveldb::Slice(key, sizeof(key)), value);
+  ops_.push_back(Op());
+  Op& op = ops_.back();
+  op.deleted = false;
+  op.instance_id = instance_id;
+  op.value = value;
 }
 
 void WriteBatch::Delete(uint64_t instance_id) {
-  char key[sizeof(instance_id)];
-  EncodeFixed64(key, instance_id);
-  batch_->Delete(leveldb::Slice(key, sizeof(key)));
+  ops_.push_back(Op());
+  Op& op = ops_.back();
+  op.deleted = true;
+  op.instance_id = instance_id;
+}
+
+void WriteBatch::Clear() { ops_.clear(); }
+
+void WriteBatch::Append(const WriteBatch& source) {
+  ops_.insert(ops_.end(), source.ops_.begin(), source.ops_.end());
+}
+
+void WriteBatch::EncodeTo(std::string* dst) const {
+  PutFixed32(dst, static_cast<uint32_t>(ops_.size()));
+  for (auto& op : ops_) {
+    dst->push_back(op.deleted ? 1 : 0);
+    PutFixed64(dst, op.instance_id);
+    PutFixed32(dst, static_cast<uint32_t>(op.value.size()));
+    dst->append(op.value);
+  }
 }
 
-void WriteBatch::Clear() { batch_->Clear(); }
+bool WriteBatch::DecodeFrom(Slice* input) {
+  static const size_t kOpHeader = 1 + sizeof(uint64_t) + sizeof(uint32_t);
+  if (input->size() < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t count = DecodeFixed32(input->data());
+  input->remove_prefix(sizeof(uint32_t));
+  for (uint32_t i = 0; i < count; ++i) {
+    if (input->size() < kOpHeader) {
+      return false;
+    }
+    const char* p = input->data();
+    uint32_t length = DecodeFixed32(p + 1 + sizeof(uint64_t));
+    if (input->size() - kOpHeader < length) {
+      return false;
+    }
+    ops_.push_back(Op());
+    Op& op = ops_.back();
+    op.deleted = (p[0] != 0);
+    op.instance_id = DecodeFixed64(p + 1);
+    op.value.assign(p + kOpHeader, length);
+    input->remove_prefix(kOpHeader + length);
+  }
+  return true;
+}
 
 }  // namespace skywalker
@@ -5,14 +5,15 @@
 #ifndef SKYWALKER_STORAGE_WRITE_BATCH_H_
 #define SKYWALKER_STORAGE_WRITE_BATCH_H_
 
+#include <stdint.h>
+
 #include <string>
+#include <vector>
 
-#include <leveldb/write_batch.h>
+#include "skywalker/slice.h"
 
 namespace skywalker {
 
-class DB;
-
 class WriteBatch {
  public:
   WriteBatch();
@@ -24,10 +25,32 @@ class WriteBatch {
 
   void Clear();
 
+  // Appends the operations of source to this batch.
+  void Append(const WriteBatch& source);
+
+  void Swap(WriteBatch* other) { ops_.swap(other->ops_); }
+
+  // Appends the operations to *dst, which can be decoded by DecodeFrom().
+  void EncodeTo(std::string* dst) const;
+
+  // Appends the operations encoded at the beginning of *input to this batch
+  // and advances *input past them. Returns false if *input is corrupted.
+  bool DecodeFrom(Slice* input);
+
+  size_t Count() const { return ops_.size(); }
+
  private:
   friend class DB;
+  friend class LevelDBStorage;
+  friend class SegmentStorage;
+
+  struct Op {
+    bool deleted;
+    uint64_t instance_id;
+    std::string value;
+  };
 
-  leveldb::WriteBatch* batch_;
+  std::vector<Op> ops_;
 
   // Intentionally copyable
 };
@@ -0,0 +1,70 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_UTIL_COMPRESSION_H_
+#define SKYWALKER_UTIL_COMPRESSION_H_
+
+#include <stddef.h>
+#include <string>
+
+#ifdef SNAPPY
+#include <snappy.h>
+#endif
+
+namespace skywalker {
+
+// Returns true if skywalker is built with snappy.
+inline bool SnappySupported() {
+#ifdef SNAPPY
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Appends the compressed input to *output.
+inline bool SnappyCompress(const char* input, size_t length,
+                           std::string* output) {
+#ifdef SNAPPY
+  size_t offset = output->size();
+  output->resize(offset + snappy::MaxCompressedLength(length));
+  size_t outlen;
+  snappy::RawCompress(input, length, &(*output)[offset], &outlen);
+  output->resize(offset + outlen);
+  return true;
+#else
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif
+}
+
+inline bool SnappyGetUncompressedLength(const char* input, size_t length,
+                                        size_t* result) {
+#ifdef SNAPPY
+  return snappy::GetUncompressedLength(input, length, result);
+#else
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif
+}
+
+// The output must have the space of the uncompressed length.
+inline bool SnappyUncompress(const char* input, size_t length, char* output) {
+#ifdef SNAPPY
+  return snappy::RawUncompress(input, length, output);
+#else
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif
+}
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_UTIL_COMPRESSION_H_
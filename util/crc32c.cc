@@ -0,0 +1,43 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "util/crc32c.h"
+
+namespace skywalker {
+namespace crc32c {
+
+namespace {
+
+// The reversed Castagnoli polynomial.
+static const uint32_t kPoly = 0x82f63b78;
+
+struct Table {
+  uint32_t t[256];
+
+  Table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (kPoly ^ (c >> 1)) : (c >> 1);
+      }
+      t[i] = c;
+    }
+  }
+};
+
+static const Table kTable;
+
+}  // namespace
+
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  uint32_t c = init_crc ^ 0xffffffffu;
+  for (size_t i = 0; i < n; ++i) {
+    c = kTable.t[(c ^ p[i]) & 0xff] ^ (c >> 8);
+  }
+  return c ^ 0xffffffffu;
+}
+
+}  // namespace crc32c
+}  // namespace skywalker
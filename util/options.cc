@@ -10,14 +10,31 @@ GroupOptions::GroupOptions()
     : use_master(true),
       log_sync(true),
       master_lease_time(10 * 1000 * 1000),
+      stable_master(false),
       sync_interval(5),
       keep_log_count(100000),
+      propose_window(1),
+      batch_count(1),
+      batch_bytes(1024 * 1024),
+      phase1_quorum(0),
+      phase2_quorum(0),
       log_storage_path(""),
+      log_storage_type(kLevelDBStorage),
+      segment_size(64 * 1024 * 1024),
       checkpoint(nullptr),
       machines(),
       membership(),
       followers() {}
 
-Options::Options() : io_thread_size(0), callback_thread_size(1) {}
+Options::Options()
+    : network_thread_size(1),
+      compression(kSnappyCompression),
+      compression_threshold(1024),
+      io_thread_size(0),
+      callback_thread_size(1),
+      recover_thread_size(0),
+      group_commit(false),
+      group_commit_time(200),
+      group_commit_path("") {}
 
 }  // namespace skywalker
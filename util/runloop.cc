@@ -11,46 +11,115 @@
 
 #include "skywalker/logging.h"
 #include "util/mutexlock.h"
+#include "util/scheduler.h"
 #include "util/thread.h"
 
 namespace skywalker {
 
+namespace {
+
+// The hosted loop which the current worker is running.
+__thread RunLoop* current_loop = nullptr;
+
+}  // namespace
+
 RunLoop::RunLoop()
     : exit_(false),
       tid_(CurrentThread::Tid()),
+      scheduler_(nullptr),
+      home_(0),
+      scheduled_(false),
+      wakeup_(0),
+      tasks_(nullptr),
+      parked_(false),
+      mutex_(),
+      cond_(&mutex_),
+      timers_(this) {}
+
+RunLoop::RunLoop(Scheduler* scheduler)
+    : exit_(false),
+      tid_(0),
+      scheduler_(scheduler),
+      home_(0),
+      scheduled_(false),
+      wakeup_(0),
+      tasks_(nullptr),
+      parked_(false),
       mutex_(),
       cond_(&mutex_),
       timers_(this) {}
 
+RunLoop::~RunLoop() {
+  Task* task = TakeTasks();
+  while (task != nullptr) {
+    Task* next = task->next;
+    delete task;
+    task = next;
+  }
+}
+
 void RunLoop::Loop() {
+  assert(scheduler_ == nullptr);
   AssertInMyLoop();
   exit_ = false;
-  std::vector<Func> funcs;
   while (!exit_) {
     uint64_t timeout = timers_.TimeoutMicros();
-    {
+    Task* task = TakeTasks();
+    if (task == nullptr && timeout != 0) {
+      // A producer sees parked_ after pushing, or the loop sees its task.
       MutexLock lock(&mutex_);
-      if (funcs_.empty()) {
+      parked_ = true;
+      if (tasks_.load() == nullptr && !exit_) {
         cond_.Wait(timeout);
       }
-      funcs.swap(funcs_);
+      parked_ = false;
+      task = TakeTasks();
     }
     timers_.RunTimerProcs();
-    for (auto& f : funcs) {
-      f();
+    while (task != nullptr) {
+      Task* next = task->next;
+      task->Run();
+      delete task;
+      task = next;
     }
-    funcs.clear();
   }
+  MutexLock lock(&mutex_);
+}
+
+uint64_t RunLoop::RunTasks() {
+  assert(scheduler_ != nullptr);
+  current_loop = this;
+  Task* task = TakeTasks();
+  timers_.RunTimerProcs();
+  while (task != nullptr) {
+    Task* next = task->next;
+    task->Run();
+    delete task;
+    task = next;
+  }
+  uint64_t timeout = timers_.TimeoutMicros();
+  current_loop = nullptr;
+  return timeout;
 }
 
+// When the loop is exited from another thread, the loop takes the mutex
+// before it returns, so it isn't destroyed while it's being woken up.
 void RunLoop::Exit() {
-  exit_ = true;
-  if (!IsInMyLoop()) {
+  if (scheduler_ == nullptr && !IsInMyLoop()) {
+    MutexLock lock(&mutex_);
+    exit_ = true;
     cond_.Signal();
+  } else {
+    exit_ = true;
   }
 }
 
-bool RunLoop::IsInMyLoop() const { return tid_ == CurrentThread::Tid(); }
+bool RunLoop::IsInMyLoop() const {
+  if (scheduler_ != nullptr) {
+    return current_loop == this;
+  }
+  return tid_ == CurrentThread::Tid();
+}
 
 void RunLoop::AssertInMyLoop() {
   if (!IsInMyLoop()) {
@@ -60,31 +129,35 @@ void RunLoop::AssertInMyLoop() {
   }
 }
 
-void RunLoop::RunInLoop(const Func& func) {
-  if (IsInMyLoop()) {
-    func();
-  } else {
-    QueueInLoop(func);
+void RunLoop::Push(Task* task) {
+  Task* head = tasks_.load(std::memory_order_relaxed);
+  do {
+    task->next = head;
+  } while (!tasks_.compare_exchange_weak(head, task));
+  if (scheduler_ != nullptr) {
+    if (!scheduled_.exchange(true)) {
+      scheduler_->Schedule(this);
+    }
+  } else if (parked_) {
+    Wakeup();
   }
 }
 
-void RunLoop::RunInLoop(Func&& func) {
-  if (IsInMyLoop()) {
-    func();
-  } else {
-    QueueInLoop(std::move(func));
+// Returns the tasks in the order they were pushed.
+RunLoop::Task* RunLoop::TakeTasks() {
+  Task* task = tasks_.exchange(nullptr);
+  Task* result = nullptr;
+  while (task != nullptr) {
+    Task* next = task->next;
+    task->next = result;
+    result = task;
+    task = next;
   }
+  return result;
 }
 
-void RunLoop::QueueInLoop(const Func& func) {
+void RunLoop::Wakeup() {
   MutexLock lock(&mutex_);
-  funcs_.push_back(func);
-  cond_.Signal();
-}
-
-void RunLoop::QueueInLoop(Func&& func) {
-  MutexLock lock(&mutex_);
-  funcs_.push_back(std::move(func));
   cond_.Signal();
 }
 
@@ -113,6 +186,10 @@ TimerId RunLoop::RunEvery(uint64_t micros_interval, TimerProcCallback&& cb) {
   return timers_.RunEvery(micros_interval, std::move(cb));
 }
 
+bool RunLoop::Restart(TimerId t, uint64_t micros_delay) {
+  return timers_.Restart(t, micros_delay);
+}
+
 void RunLoop::Remove(TimerId t) { timers_.Remove(t); }
 
 }  // namespace skywalker
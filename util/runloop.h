@@ -6,19 +6,31 @@
 #define SKYWALKER_UTIL_RUNLOOP_H_
 
 #include <stdint.h>
+#include <atomic>
 #include <functional>
-#include <vector>
+#include <type_traits>
+#include <utility>
 
 #include "util/mutex.h"
 #include "util/timerlist.h"
 
 namespace skywalker {
 
+class Scheduler;
+
+// The functions are queued into a lock-free list by any thread, and the
+// loop takes all of them at one time. The mutex and the condition are
+// only used to wake up the loop when it is parked.
+//
+// A loop created by a scheduler has no thread of its own and Loop() isn't
+// called, it is run by the workers of the scheduler when it's runnable.
 class RunLoop {
  public:
   typedef std::function<void()> Func;
 
   RunLoop();
+  explicit RunLoop(Scheduler* scheduler);
+  ~RunLoop();
 
   void Loop();
   void Exit();
@@ -26,10 +38,21 @@ class RunLoop {
   bool IsInMyLoop() const;
   void AssertInMyLoop();
 
-  void RunInLoop(const Func& func);
-  void RunInLoop(Func&& func);
-  void QueueInLoop(const Func& func);
-  void QueueInLoop(Func&& func);
+  template <typename F>
+  void RunInLoop(F&& func) {
+    if (IsInMyLoop()) {
+      func();
+    } else {
+      QueueInLoop(std::forward<F>(func));
+    }
+  }
+
+  // The function is kept in the task node itself, so a lambda is queued
+  // without being wrapped into a Func.
+  template <typename F>
+  void QueueInLoop(F&& func) {
+    Push(new TaskImpl<typename std::decay<F>::type>(std::forward<F>(func)));
+  }
 
   TimerId RunAt(uint64_t micros_value, const TimerProcCallback& cb);
   TimerId RunAfter(uint64_t micros_delay, const TimerProcCallback& cb);
@@ -39,15 +62,55 @@ class RunLoop {
   TimerId RunAfter(uint64_t micros_delay, TimerProcCallback&& cb);
   TimerId RunEvery(uint64_t micros_interval, TimerProcCallback&& cb);
 
+  // Must be called in the loop.
+  bool Restart(TimerId t, uint64_t micros_delay);
+
   void Remove(TimerId t);
 
  private:
-  bool exit_;
+  friend class Scheduler;
+
+  struct Task {
+    Task() : next(nullptr) {}
+    virtual ~Task() {}
+    virtual void Run() = 0;
+    Task* next;
+  };
+
+  template <typename F>
+  struct TaskImpl : public Task {
+    template <typename T>
+    explicit TaskImpl(T&& f) : func(std::forward<T>(f)) {}
+    virtual void Run() { func(); }
+    F func;
+  };
+
+  void Push(Task* task);
+  Task* TakeTasks();
+  void Wakeup();
+
+  // Runs the expired timers and the queued tasks once, and returns the
+  // time until the next timer expires. Only used by the scheduler.
+  uint64_t RunTasks();
+  bool HasTasks() const { return tasks_.load() != nullptr; }
+
+  std::atomic<bool> exit_;
   const uint64_t tid_;
 
+  // Only used when the loop is run by a scheduler. The scheduled_ is true
+  // from the time the loop is queued to a worker until it has been run,
+  // and the wakeup_ is the time when its timers expire, 0 for none.
+  Scheduler* const scheduler_;
+  size_t home_;
+  std::atomic<bool> scheduled_;
+  std::atomic<uint64_t> wakeup_;
+
+  // The tasks are pushed in the reverse order.
+  std::atomic<Task*> tasks_;
+  std::atomic<bool> parked_;
+
   Mutex mutex_;
   Condition cond_;
-  std::vector<Func> funcs_;
   TimerList timers_;
 
   // No copying allowed
@@ -0,0 +1,214 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "util/scheduler.h"
+
+#include <assert.h>
+
+#include "util/mutexlock.h"
+#include "util/runloop.h"
+#include "util/timeops.h"
+
+namespace skywalker {
+
+namespace {
+
+// The worker which the current thread runs.
+__thread void* current_worker = nullptr;
+
+const uint64_t kNoWakeup = static_cast<uint64_t>(-1);
+
+}  // namespace
+
+Scheduler::Scheduler()
+    : stop_(false),
+      next_(0),
+      mutex_(),
+      cond_(&mutex_),
+      idle_(0),
+      next_wakeup_(kNoWakeup) {}
+
+Scheduler::~Scheduler() {
+  stop_ = true;
+  {
+    MutexLock lock(&mutex_);
+    cond_.SignalAll();
+  }
+  for (auto& w : workers_) {
+    w->thread.Join();
+  }
+}
+
+void Scheduler::Start(uint32_t thread_size) {
+  assert(workers_.empty());
+  for (uint32_t i = 0; i < thread_size; ++i) {
+    std::unique_ptr<Worker> w(new Worker());
+    w->scheduler = this;
+    w->index = i;
+    workers_.push_back(std::move(w));
+  }
+  for (auto& w : workers_) {
+    w->thread.Start(&Scheduler::StartWorker, w.get());
+  }
+}
+
+RunLoop* Scheduler::NewLoop() {
+  assert(!workers_.empty());
+  RunLoop* loop = new RunLoop(this);
+  loop->home_ = next_++ % workers_.size();
+  loops_.push_back(std::unique_ptr<RunLoop>(loop));
+  return loop;
+}
+
+void* Scheduler::StartWorker(void* arg) {
+  Worker* w = reinterpret_cast<Worker*>(arg);
+  current_worker = w;
+  w->scheduler->WorkerLoop(w);
+  return nullptr;
+}
+
+void Scheduler::Schedule(RunLoop* loop) {
+  Worker* w = reinterpret_cast<Worker*>(current_worker);
+  if (w == nullptr || w->scheduler != this) {
+    w = workers_[loop->home_].get();
+  }
+  Push(w, loop);
+}
+
+void Scheduler::WorkerLoop(Worker* worker) {
+  while (!stop_) {
+    RunWakeups();
+    RunLoop* loop = Pop(worker);
+    if (loop == nullptr) {
+      loop = Steal(worker);
+    }
+    if (loop != nullptr) {
+      Run(worker, loop);
+      continue;
+    }
+
+    // A loop which is pushed after idle_ is increased will be seen by
+    // HasRunnable, or the pusher will see idle_ and signal.
+    MutexLock lock(&mutex_);
+    ++idle_;
+    if (!stop_ && !HasRunnable()) {
+      uint64_t when = next_wakeup_;
+      uint64_t now = NowMonotonicMicros();
+      if (when == kNoWakeup) {
+        cond_.Wait();
+      } else if (when > now) {
+        cond_.Wait(when - now);
+      }
+    }
+    --idle_;
+  }
+}
+
+void Scheduler::Push(Worker* worker, RunLoop* loop) {
+  {
+    MutexLock lock(&worker->mutex);
+    worker->queue.push_back(loop);
+  }
+  if (idle_ > 0) {
+    MutexLock lock(&mutex_);
+    cond_.Signal();
+  }
+}
+
+RunLoop* Scheduler::Pop(Worker* worker) {
+  MutexLock lock(&worker->mutex);
+  if (worker->queue.empty()) {
+    return nullptr;
+  }
+  RunLoop* loop = worker->queue.front();
+  worker->queue.pop_front();
+  return loop;
+}
+
+// Takes the loop which has waited the shortest time in another queue, the
+// older ones are left to their own worker.
+RunLoop* Scheduler::Steal(Worker* worker) {
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker* w = workers_[(worker->index + i) % workers_.size()].get();
+    MutexLock lock(&w->mutex);
+    if (!w->queue.empty()) {
+      RunLoop* loop = w->queue.back();
+      w->queue.pop_back();
+      return loop;
+    }
+  }
+  return nullptr;
+}
+
+bool Scheduler::HasRunnable() {
+  for (auto& w : workers_) {
+    MutexLock lock(&w->mutex);
+    if (!w->queue.empty()) {
+      return true;
+    }
+  }
+  return next_wakeup_ <= NowMonotonicMicros();
+}
+
+// The loop is kept scheduled while it is running, so that no other worker
+// can run it at the same time.
+void Scheduler::Run(Worker* worker, RunLoop* loop) {
+  uint64_t timeout = loop->RunTasks();
+  if (timeout == 0) {
+    Push(worker, loop);
+    return;
+  }
+  if (timeout != kNoWakeup) {
+    AddWakeup(loop, NowMonotonicMicros() + timeout);
+  }
+  loop->scheduled_ = false;
+  if (loop->HasTasks() && !loop->scheduled_.exchange(true)) {
+    Push(worker, loop);
+  }
+}
+
+// Only an earlier wakeup replaces the old one, the loop which is woken up
+// too early adds its wakeup again.
+void Scheduler::AddWakeup(RunLoop* loop, uint64_t when) {
+  uint64_t wakeup = loop->wakeup_;
+  if (wakeup != 0 && wakeup <= when) {
+    return;
+  }
+  MutexLock lock(&mutex_);
+  if (loop->wakeup_ != 0) {
+    wakeups_.erase(std::make_pair(loop->wakeup_.load(), loop));
+  }
+  loop->wakeup_ = when;
+  wakeups_.insert(std::make_pair(when, loop));
+  if (wakeups_.begin()->first != next_wakeup_) {
+    next_wakeup_ = wakeups_.begin()->first;
+    // The idle workers wait for the earlier time.
+    cond_.Signal();
+  }
+}
+
+void Scheduler::RunWakeups() {
+  uint64_t now = NowMonotonicMicros();
+  if (next_wakeup_ > now) {
+    return;
+  }
+  std::vector<RunLoop*> loops;
+  {
+    MutexLock lock(&mutex_);
+    while (!wakeups_.empty() && wakeups_.begin()->first <= now) {
+      RunLoop* loop = wakeups_.begin()->second;
+      loop->wakeup_ = 0;
+      loops.push_back(loop);
+      wakeups_.erase(wakeups_.begin());
+    }
+    next_wakeup_ = wakeups_.empty() ? kNoWakeup : wakeups_.begin()->first;
+  }
+  for (auto& loop : loops) {
+    // The loop may be running now and have read its old wakeup, so an
+    // empty task is queued to make sure that it runs once more.
+    loop->QueueInLoop([]() {});
+  }
+}
+
+}  // namespace skywalker
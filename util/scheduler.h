@@ -0,0 +1,85 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_UTIL_SCHEDULER_H_
+#define SKYWALKER_UTIL_SCHEDULER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "util/mutex.h"
+#include "util/thread.h"
+
+namespace skywalker {
+
+class RunLoop;
+
+// Runs the loops which have no threads of their own on a few worker
+// threads. A loop is runnable when it has tasks or its timers expire, and
+// it is run by at most one worker at a time, so everything in a loop is
+// still single-threaded. Every worker takes the runnable loops from its
+// own queue first, and steals them from the others when it is idle, so
+// the busy loops are spread over all the workers.
+class Scheduler {
+ public:
+  Scheduler();
+  ~Scheduler();
+
+  void Start(uint32_t thread_size);
+
+  // The loop is owned by the scheduler, and its tasks are queued to the
+  // worker which it is assigned to when they aren't queued by a worker.
+  RunLoop* NewLoop();
+
+ private:
+  friend class RunLoop;
+
+  struct Worker {
+    Scheduler* scheduler;
+    size_t index;
+    Mutex mutex;
+    std::deque<RunLoop*> queue;
+    Thread thread;
+  };
+
+  static void* StartWorker(void* arg);
+
+  // Called by the loop when it becomes runnable.
+  void Schedule(RunLoop* loop);
+
+  void WorkerLoop(Worker* worker);
+  void Push(Worker* worker, RunLoop* loop);
+  RunLoop* Pop(Worker* worker);
+  RunLoop* Steal(Worker* worker);
+  bool HasRunnable();
+  void Run(Worker* worker, RunLoop* loop);
+  void AddWakeup(RunLoop* loop, uint64_t when);
+  void RunWakeups();
+
+  std::atomic<bool> stop_;
+  size_t next_;
+  std::vector<std::unique_ptr<Worker> > workers_;
+  std::vector<std::unique_ptr<RunLoop> > loops_;
+
+  // The idle workers wait on the cond_ until a loop becomes runnable or
+  // the earliest wakeup comes.
+  Mutex mutex_;
+  Condition cond_;
+  std::atomic<int> idle_;
+  std::set<std::pair<uint64_t, RunLoop*> > wakeups_;
+  std::atomic<uint64_t> next_wakeup_;
+
+  // No copying allowed
+  Scheduler(const Scheduler&);
+  void operator=(const Scheduler&);
+};
+
+}  // namespace skywalker
+
+#endif  // SKYWALKER_UTIL_SCHEDULER_H_
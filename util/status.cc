@@ -58,6 +58,9 @@ std::string Status::ToString() const {
       case kIOError:
         type = "IOError: ";
         break;
+      case kNotMaster:
+        type = "NotMaster: ";
+        break;
       default:
         snprintf(tmp, sizeof(tmp),
                  "Unknown code(%d): ", static_cast<int>(code()));
@@ -0,0 +1,72 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SKYWALKER_UTIL_TESTHARNESS_H_
+#define SKYWALKER_UTIL_TESTHARNESS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+namespace skywalker {
+namespace test {
+
+// A test program defines its tests with TEST() and runs them with
+//    int main() { return skywalker::test::RunAllTests(); }
+// A failed CHECK() ends the program at once, also when NDEBUG is defined.
+
+struct Test {
+  const char* base;
+  const char* name;
+  void (*func)();
+};
+
+inline std::vector<Test>* Tests() {
+  static std::vector<Test> tests;
+  return &tests;
+}
+
+inline bool RegisterTest(const char* base, const char* name, void (*func)()) {
+  Test t;
+  t.base = base;
+  t.name = name;
+  t.func = func;
+  Tests()->push_back(t);
+  return true;
+}
+
+// Runs the tests in the order of their definitions.
+inline int RunAllTests() {
+  for (auto& t : *Tests()) {
+    fprintf(stderr, "==== Test %s.%s\n", t.base, t.name);
+    (*t.func)();
+  }
+  fprintf(stderr, "==== PASSED %d tests\n", static_cast<int>(Tests()->size()));
+  return 0;
+}
+
+}  // namespace test
+}  // namespace skywalker
+
+#define CHECK(cond)                                                    \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+              #cond);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+#define TEST(base, name)                                           \
+  class base##_##name##_Test {                                     \
+   public:                                                         \
+    static void Run();                                             \
+  };                                                               \
+  static bool base##_##name##_registered =                         \
+      ::skywalker::test::RegisterTest(#base, #name,                \
+                                      &base##_##name##_Test::Run); \
+  void base##_##name##_Test::Run()
+
+#endif  // SKYWALKER_UTIL_TESTHARNESS_H_
@@ -0,0 +1,145 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "util/runloop.h"
+#include "util/runloop_thread.h"
+#include "util/scheduler.h"
+#include "util/testharness.h"
+#include "util/thread.h"
+#include "util/timeops.h"
+
+namespace skywalker {
+
+// Waits until the flag is set by the loop, or fails after 10 seconds.
+static void WaitFor(const std::atomic<bool>& done) {
+  uint64_t deadline = NowMonotonicMicros() + 10 * 1000 * 1000;
+  while (!done) {
+    CHECK(NowMonotonicMicros() < deadline);
+    SleepForMicroseconds(100);
+  }
+}
+
+static const int kProducers = 4;
+static const uint64_t kTasks = 100000;
+
+struct ProducerContext {
+  RunLoop* loop;
+  int id;
+  // Only accessed in the loop.
+  std::vector<uint64_t>* last;
+};
+
+static void* Produce(void* arg) {
+  ProducerContext* ctx = reinterpret_cast<ProducerContext*>(arg);
+  RunLoop* loop = ctx->loop;
+  int id = ctx->id;
+  std::vector<uint64_t>* last = ctx->last;
+  for (uint64_t i = 1; i <= kTasks; ++i) {
+    loop->QueueInLoop([loop, id, i, last]() {
+      CHECK(loop->IsInMyLoop());
+      CHECK((*last)[id] + 1 == i);
+      (*last)[id] = i;
+    });
+  }
+  return nullptr;
+}
+
+// The tasks of every producer run in the order in which they are queued,
+// and none of them is lost.
+TEST(RunLoopTest, Producers) {
+  RunLoopThread thread;
+  RunLoop* loop = thread.Loop();
+  std::vector<uint64_t> last(kProducers, 0);
+  std::vector<ProducerContext> ctx(kProducers);
+  std::vector<std::unique_ptr<Thread>> producers;
+  for (int i = 0; i < kProducers; ++i) {
+    ctx[i].loop = loop;
+    ctx[i].id = i;
+    ctx[i].last = &last;
+    producers.push_back(std::unique_ptr<Thread>(new Thread()));
+    producers.back()->Start(&Produce, &ctx[i]);
+  }
+  for (auto& t : producers) {
+    t->Join();
+  }
+
+  std::atomic<bool> done(false);
+  loop->QueueInLoop([&last, &done]() {
+    for (auto n : last) {
+      CHECK(n == kTasks);
+    }
+    done = true;
+  });
+  WaitFor(done);
+}
+
+// An idle loop is woken up by every task which is queued to it.
+TEST(RunLoopTest, Wakeup) {
+  RunLoopThread thread;
+  RunLoop* loop = thread.Loop();
+  for (int i = 0; i < 100; ++i) {
+    std::atomic<bool> done(false);
+    loop->QueueInLoop([&done]() { done = true; });
+    WaitFor(done);
+    SleepForMicroseconds(static_cast<uint64_t>(i % 10) * 100);
+  }
+}
+
+// The tasks which are queued by a task run after it, and RunInLoop runs
+// the task at once in the loop.
+TEST(RunLoopTest, InLoop) {
+  RunLoopThread thread;
+  RunLoop* loop = thread.Loop();
+  std::vector<int> order;
+  std::atomic<bool> done(false);
+  loop->QueueInLoop([loop, &order, &done]() {
+    loop->QueueInLoop([&order, &done]() {
+      order.push_back(3);
+      done = true;
+    });
+    loop->RunInLoop([&order]() { order.push_back(1); });
+    order.push_back(2);
+  });
+  WaitFor(done);
+  CHECK(order.size() == 3);
+  CHECK(order[0] == 1 && order[1] == 2 && order[2] == 3);
+}
+
+// The loops of a scheduler are run by one worker at a time.
+TEST(RunLoopTest, Scheduler) {
+  Scheduler scheduler;
+  scheduler.Start(4);
+  const size_t kLoops = 16;
+  std::vector<RunLoop*> loops;
+  std::vector<uint64_t> last(kLoops, 0);
+  std::vector<uint64_t> expected(kLoops, 0);
+  for (size_t i = 0; i < kLoops; ++i) {
+    loops.push_back(scheduler.NewLoop());
+  }
+  for (uint64_t n = 1; n <= kTasks; ++n) {
+    size_t i = n % kLoops;
+    RunLoop* loop = loops[i];
+    uint64_t* prev = &last[i];
+    loop->QueueInLoop([loop, prev, n]() {
+      CHECK(loop->IsInMyLoop());
+      CHECK(*prev < n);
+      *prev = n;
+    });
+    expected[i] = n;
+  }
+  for (size_t i = 0; i < kLoops; ++i) {
+    std::atomic<bool> done(false);
+    loops[i]->QueueInLoop([&done]() { done = true; });
+    WaitFor(done);
+    CHECK(last[i] == expected[i]);
+  }
+}
+
+}  // namespace skywalker
+
+int main() { return skywalker::test::RunAllTests(); }
@@ -0,0 +1,124 @@
+// Copyright (c) 2016 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <vector>
+
+#include "util/runloop.h"
+#include "util/testharness.h"
+#include "util/thread.h"
+#include "util/timeops.h"
+
+namespace skywalker {
+
+// A timer may run late when the machine is busy, but never early.
+static const uint64_t kMaxLateMicros = 200 * 1000;
+
+static void CheckTime(uint64_t expected) {
+  uint64_t now = NowMonotonicMicros();
+  CHECK(now >= expected);
+  CHECK(now <= expected + kMaxLateMicros);
+}
+
+// The delays cover the first level and the cascades from the higher ones.
+TEST(TimerListTest, RunAfter) {
+  RunLoop loop;
+  const int kTimers = 2000;
+  std::vector<TimerId> timers;
+  int fired = 0;
+  srand(1);
+  for (int i = 0; i < kTimers; ++i) {
+    uint64_t delay = (i % 4 == 0) ? static_cast<uint64_t>(rand() % 1500000)
+                                  : static_cast<uint64_t>(rand() % 20000);
+    uint64_t expected = NowMonotonicMicros() + delay;
+    bool removed = (i % 5 == 0);
+    timers.push_back(loop.RunAfter(delay, [expected, removed, &fired]() {
+      CHECK(!removed);
+      CheckTime(expected);
+      ++fired;
+    }));
+  }
+  for (int i = 0; i < kTimers; i += 5) {
+    loop.Remove(timers[i]);
+  }
+  loop.RunAfter(1600000, [&loop]() { loop.Exit(); });
+  loop.Loop();
+  CHECK(fired == kTimers - kTimers / 5);
+}
+
+TEST(TimerListTest, Restart) {
+  RunLoop loop;
+  uint64_t start = NowMonotonicMicros();
+  bool restarted = false;
+  TimerId t = loop.RunAfter(10000, [start, &restarted]() {
+    CheckTime(start + 300000);
+    restarted = true;
+  });
+  CHECK(loop.Restart(t, 300000));
+
+  TimerId done = loop.RunAfter(1000, []() {});
+  loop.RunAfter(400000, [&loop, done, t]() {
+    // The timers which have run can't be restarted or removed again.
+    CHECK(!loop.Restart(done, 1000));
+    CHECK(!loop.Restart(t, 1000));
+    loop.Remove(done);
+    loop.Exit();
+  });
+  loop.Loop();
+  CHECK(restarted);
+}
+
+TEST(TimerListTest, RunEvery) {
+  RunLoop loop;
+  int count = 0;
+  TimerId every;
+  every = loop.RunEvery(20000, [&loop, &count, &every]() {
+    if (++count == 10) {
+      loop.Remove(every);
+    }
+  });
+  loop.RunAfter(500000, [&loop]() { loop.Exit(); });
+  loop.Loop();
+  CHECK(count == 10);
+}
+
+struct AddContext {
+  RunLoop* loop;
+  std::atomic<int>* fired;
+};
+
+static void* AddTimers(void* arg) {
+  AddContext* ctx = reinterpret_cast<AddContext*>(arg);
+  for (int i = 0; i < 100; ++i) {
+    uint64_t delay = 1000 + static_cast<uint64_t>(i) * 100;
+    uint64_t expected = NowMonotonicMicros() + delay;
+    std::atomic<int>* fired = ctx->fired;
+    ctx->loop->RunAfter(delay, [expected, fired]() {
+      CheckTime(expected);
+      ++*fired;
+    });
+  }
+  return nullptr;
+}
+
+// The timers may be added in other threads.
+TEST(TimerListTest, OtherThread) {
+  RunLoop loop;
+  std::atomic<int> fired(0);
+  AddContext ctx;
+  ctx.loop = &loop;
+  ctx.fired = &fired;
+  Thread thread;
+  thread.Start(&AddTimers, &ctx);
+  loop.RunAfter(200000, [&loop]() { loop.Exit(); });
+  loop.Loop();
+  thread.Join();
+  CHECK(fired == 100);
+}
+
+}  // namespace skywalker
+
+int main() { return skywalker::test::RunAllTests(); }
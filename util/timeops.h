@@ -13,6 +13,9 @@ extern uint64_t NowMillis();
 
 extern uint64_t NowMicros();
 
+// Not affected by the changes of the system time.
+extern uint64_t NowMonotonicMicros();
+
 extern void SleepForMicroseconds(int micros);
 
 }  // namespace skywalker
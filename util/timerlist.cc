@@ -3,6 +3,10 @@
 // found in the LICENSE file.
 
 #include "util/timerlist.h"
+
+#include <string.h>
+
+#include "util/mutexlock.h"
 #include "util/runloop.h"
 #include "util/timeops.h"
 
@@ -12,146 +16,319 @@ class Timer {
  private:
   friend class TimerList;
 
-  Timer(uint64_t value, uint64_t interval, const TimerProcCallback& cb)
-      : micros_value(value), micros_interval(interval), timerproc_cb(cb) {}
-
-  Timer(uint64_t value, uint64_t interval, TimerProcCallback&& cb)
-      : micros_value(value),
-        micros_interval(interval),
-        timerproc_cb(std::move(cb)) {}
+  Timer()
+      : sequence(0),
+        expires(0),
+        micros_interval(0),
+        prev(nullptr),
+        next(nullptr),
+        slot(nullptr),
+        level(0) {}
 
   ~Timer() {}
 
-  uint64_t micros_value;
+  // Zero if the node is free.
+  uint64_t sequence;
+  uint64_t expires;
   uint64_t micros_interval;
   TimerProcCallback timerproc_cb;
+
+  // The slot which the timer is linked in, nullptr if it isn't linked.
+  Timer* prev;
+  Timer* next;
+  Timer** slot;
+  int level;
 };
 
+namespace {
+
+uint64_t CeilTicks(uint64_t micros, uint64_t tick) {
+  return (micros + tick - 1) / tick;
+}
+
+}  // namespace
+
 TimerList::TimerList(RunLoop* loop)
-    : last_time_out_(NowMicros()), loop_(loop) {}
+    : loop_(loop),
+      current_tick_(NowMonotonicMicros() / kTickMicros),
+      expired_(nullptr),
+      mutex_(),
+      sequence_(0) {
+  memset(root_, 0, sizeof(root_));
+  memset(levels_, 0, sizeof(levels_));
+  memset(counts_, 0, sizeof(counts_));
+}
 
 TimerList::~TimerList() {
-  for (auto& t : timer_ptrs_) {
-    delete t;
+  for (auto& chunk : chunks_) {
+    delete[] chunk;
   }
 }
 
 TimerId TimerList::RunAt(uint64_t micros_value, const TimerProcCallback& cb) {
-  TimerId timer(micros_value, new Timer(micros_value, 0, cb));
-  InsertInLoop(timer);
-  return timer;
+  uint64_t now = NowMicros();
+  return Add(micros_value > now ? micros_value - now : 0, 0,
+             TimerProcCallback(cb));
 }
 
 TimerId TimerList::RunAt(uint64_t micros_value, TimerProcCallback&& cb) {
-  TimerId timer(micros_value, new Timer(micros_value, 0, std::move(cb)));
-  InsertInLoop(timer);
-  return timer;
+  uint64_t now = NowMicros();
+  return Add(micros_value > now ? micros_value - now : 0, 0, std::move(cb));
 }
 
 TimerId TimerList::RunAfter(uint64_t micros_delay,
                             const TimerProcCallback& cb) {
-  uint64_t micros_value = NowMicros() + micros_delay;
-  TimerId timer(micros_value, new Timer(micros_value, 0, cb));
-  InsertInLoop(timer);
-  return timer;
+  return Add(micros_delay, 0, TimerProcCallback(cb));
 }
 
 TimerId TimerList::RunAfter(uint64_t micros_delay, TimerProcCallback&& cb) {
-  uint64_t micros_value = NowMicros() + micros_delay;
-  TimerId timer(micros_value, new Timer(micros_value, 0, std::move(cb)));
-  InsertInLoop(timer);
-  return timer;
+  return Add(micros_delay, 0, std::move(cb));
 }
 
 TimerId TimerList::RunEvery(uint64_t micros_interval,
                             const TimerProcCallback& cb) {
-  uint64_t micros_value = NowMicros() + micros_interval;
-  TimerId timer(micros_value, new Timer(micros_value, micros_interval, cb));
-  InsertInLoop(timer);
-  return timer;
+  return Add(micros_interval, micros_interval, TimerProcCallback(cb));
 }
 
 TimerId TimerList::RunEvery(uint64_t micros_interval, TimerProcCallback&& cb) {
-  uint64_t micros_value = NowMicros() + micros_interval;
-  TimerId timer(micros_value,
-                new Timer(micros_value, micros_interval, std::move(cb)));
-  InsertInLoop(timer);
-  return timer;
+  return Add(micros_interval, micros_interval, std::move(cb));
 }
 
-void TimerList::Remove(TimerId timer) {
-  loop_->RunInLoop([timer, this]() mutable {
-    if (timer_ptrs_.find(timer.second) != timer_ptrs_.end()) {
-      timer_ptrs_.erase(timer.second);
-      timer.first = timer.second->micros_value;
-      delete timer.second;
-      timers_.erase(timer);
+// The node is filled under the lock, since it may be removed in the loop
+// as soon as the TimerId is returned.
+TimerId TimerList::Add(uint64_t micros_delay, uint64_t micros_interval,
+                       TimerProcCallback&& cb) {
+  uint64_t expires =
+      CeilTicks(NowMonotonicMicros() + micros_delay, kTickMicros);
+  TimerId timer;
+  {
+    MutexLock lock(&mutex_);
+    if (free_timers_.empty()) {
+      Timer* chunk = new Timer[kChunkSize];
+      chunks_.push_back(chunk);
+      for (size_t i = 0; i < kChunkSize; ++i) {
+        free_timers_.push_back(&chunk[i]);
+      }
     }
-  });
+    Timer* t = free_timers_.back();
+    free_timers_.pop_back();
+    t->sequence = ++sequence_;
+    t->expires = expires;
+    t->micros_interval = micros_interval;
+    t->timerproc_cb = std::move(cb);
+    timer = TimerId(t->sequence, t);
+  }
+  if (loop_->IsInMyLoop()) {
+    InsertInLoop(timer);
+  } else {
+    loop_->QueueInLoop([timer, this]() { InsertInLoop(timer); });
+  }
+  return timer;
 }
 
-void TimerList::InsertInLoop(TimerId timer) {
-  loop_->RunInLoop([timer, this]() {
-    timers_.insert(timer);
-    timer_ptrs_.insert(timer.second);
-  });
+bool TimerList::Valid(TimerId timer) const {
+  MutexLock lock(&mutex_);
+  return timer.second != nullptr && timer.first != 0 &&
+         timer.second->sequence == timer.first;
 }
 
-uint64_t TimerList::TimeoutMicros() const {
+void TimerList::DeleteTimer(Timer* t) {
+  t->timerproc_cb = nullptr;
+  MutexLock lock(&mutex_);
+  t->sequence = 0;
+  free_timers_.push_back(t);
+}
+
+bool TimerList::Restart(TimerId timer, uint64_t micros_delay) {
   loop_->AssertInMyLoop();
-  if (timers_.empty()) {
-    return -1;
+  if (!Valid(timer)) {
+    return false;
   }
-  std::set<TimerId>::const_iterator it = timers_.begin();
-  uint64_t now = NowMicros();
-  if (now < last_time_out_) {
-    return 0;
+  Timer* t = timer.second;
+  if (t->slot != nullptr) {
+    Unlink(t);
   }
-  if (it->first <= now) {
-    return 0;
+  t->expires = CeilTicks(NowMonotonicMicros() + micros_delay, kTickMicros);
+  Link(t);
+  return true;
+}
+
+void TimerList::Remove(TimerId timer) {
+  if (loop_->IsInMyLoop()) {
+    RemoveInLoop(timer);
   } else {
-    return (it->first - now);
+    loop_->QueueInLoop([timer, this]() { RemoveInLoop(timer); });
   }
 }
 
-void TimerList::RunTimerProcs() {
-  loop_->AssertInMyLoop();
-  if (timers_.empty()) {
+// The timer may have been linked by Restart before.
+void TimerList::InsertInLoop(TimerId timer) {
+  if (Valid(timer) && timer.second->slot == nullptr) {
+    Link(timer.second);
+  }
+}
+
+void TimerList::RemoveInLoop(TimerId timer) {
+  if (Valid(timer)) {
+    Timer* t = timer.second;
+    if (t->slot != nullptr) {
+      Unlink(t);
+    }
+    DeleteTimer(t);
+  }
+}
+
+// The timers which have expired are put into the slot of the current tick.
+void TimerList::Link(Timer* t) {
+  uint64_t expires = t->expires > current_tick_ ? t->expires : current_tick_;
+  uint64_t delta = expires - current_tick_;
+  if (delta < kRootSize) {
+    LinkTo(t, &root_[expires & (kRootSize - 1)], 0);
     return;
   }
+  int shift = kRootBits;
+  for (int level = 1; level < kLevels; ++level) {
+    uint64_t span = static_cast<uint64_t>(1) << (shift + kLevelBits);
+    if (delta >= span && level == kLevels - 1) {
+      // Too far away, it is cascaded again when the slot comes.
+      expires = current_tick_ + span - 1;
+    }
+    if (delta < span || level == kLevels - 1) {
+      size_t index = static_cast<size_t>(expires >> shift) & (kLevelSize - 1);
+      LinkTo(t, &levels_[level - 1][index], level);
+      return;
+    }
+    shift += kLevelBits;
+  }
+}
+
+void TimerList::LinkTo(Timer* t, Timer** slot, int level) {
+  t->prev = nullptr;
+  t->next = *slot;
+  if (*slot != nullptr) {
+    (*slot)->prev = t;
+  }
+  *slot = t;
+  t->slot = slot;
+  t->level = level;
+  if (level >= 0) {
+    ++counts_[level];
+  }
+}
+
+void TimerList::Unlink(Timer* t) {
+  if (t->prev != nullptr) {
+    t->prev->next = t->next;
+  } else {
+    *t->slot = t->next;
+  }
+  if (t->next != nullptr) {
+    t->next->prev = t->prev;
+  }
+  if (t->level >= 0) {
+    --counts_[t->level];
+  }
+  t->prev = nullptr;
+  t->next = nullptr;
+  t->slot = nullptr;
+}
 
-  uint64_t micros_now = NowMicros();
+// Moves the timers of the current slot in the level to the lower levels,
+// and returns the index of the slot.
+size_t TimerList::Cascade(int level) {
+  int shift = kRootBits + (level - 1) * kLevelBits;
+  size_t index = static_cast<size_t>(current_tick_ >> shift) & (kLevelSize - 1);
+  Timer* t = levels_[level - 1][index];
+  levels_[level - 1][index] = nullptr;
+  while (t != nullptr) {
+    Timer* next = t->next;
+    --counts_[level];
+    t->slot = nullptr;
+    Link(t);
+    t = next;
+  }
+  return index;
+}
 
-  if (micros_now < last_time_out_) {
-    uint64_t diff = last_time_out_ - micros_now;
-    std::set<TimerId> timers;
-    for (auto& it : timers_) {
-      uint64_t value = it.first > diff ? it.first - diff : 0;
-      it.second->micros_value = value;
-      timers.insert(TimerId(value, it.second));
+// Returns the next tick at which a timer expires or the timers of a level
+// are cascaded, the ticks between them can be skipped.
+uint64_t TimerList::NextTick() const {
+  uint64_t next = static_cast<uint64_t>(-1);
+  if (counts_[0] > 0) {
+    for (size_t i = 0; i < kRootSize; ++i) {
+      if (root_[(current_tick_ + i) & (kRootSize - 1)] != nullptr) {
+        next = current_tick_ + i;
+        break;
+      }
+    }
+  }
+  for (int level = 1; level < kLevels; ++level) {
+    if (counts_[level] > 0) {
+      uint64_t span = static_cast<uint64_t>(1)
+                      << (kRootBits + (level - 1) * kLevelBits);
+      uint64_t boundary = (current_tick_ + span - 1) & ~(span - 1);
+      if (boundary < next) {
+        next = boundary;
+      }
+      break;
     }
-    timers_.swap(timers);
   }
-  last_time_out_ = micros_now;
+  return next;
+}
+
+uint64_t TimerList::TimeoutMicros() const {
+  loop_->AssertInMyLoop();
+  uint64_t next = NextTick();
+  if (next == static_cast<uint64_t>(-1)) {
+    return -1;
+  }
+  uint64_t when = next * kTickMicros;
+  uint64_t now = NowMonotonicMicros();
+  return when > now ? when - now : 0;
+}
+
+void TimerList::RunTimerProcs() {
+  loop_->AssertInMyLoop();
+  uint64_t now = NowMonotonicMicros() / kTickMicros;
+  while (current_tick_ <= now) {
+    uint64_t next = NextTick();
+    if (next > now) {
+      current_tick_ = now + 1;
+      break;
+    }
+    current_tick_ = next;
+
+    size_t index = static_cast<size_t>(current_tick_) & (kRootSize - 1);
+    if (index == 0) {
+      for (int level = 1; level < kLevels && Cascade(level) == 0; ++level) {
+      }
+    }
 
-  std::set<TimerId>::iterator it;
-  while (true) {
-    it = timers_.begin();
-    if (it != timers_.end() && it->first <= micros_now) {
-      Timer* t = it->second;
-      timers_.erase(it);
-      TimerProcCallback cb = t->timerproc_cb;
+    // The timers which are added by the callbacks go to the next ticks.
+    expired_ = root_[index];
+    root_[index] = nullptr;
+    for (Timer* t = expired_; t != nullptr; t = t->next) {
+      --counts_[0];
+      t->slot = &expired_;
+      t->level = -1;
+    }
+    ++current_tick_;
+
+    while (expired_ != nullptr) {
+      Timer* t = expired_;
+      Unlink(t);
       if (t->micros_interval > 0) {
-        t->micros_value = micros_now + t->micros_interval;
-        TimerId timer(t->micros_value, t);
-        timers_.insert(timer);
+        t->expires = CeilTicks(NowMonotonicMicros() + t->micros_interval,
+                               kTickMicros);
+        Link(t);
+        // The callback may remove the timer.
+        TimerProcCallback cb = t->timerproc_cb;
+        cb();
       } else {
-        delete t;
-        timer_ptrs_.erase(t);
+        TimerProcCallback cb(std::move(t->timerproc_cb));
+        DeleteTimer(t);
+        cb();
       }
-      cb();
-    } else {
-      break;
     }
   }
 }
@@ -6,10 +6,11 @@
 #define SKYWALKER_UTIL_TIMERLIST_H_
 
 #include <stdint.h>
-#include <set>
 #include <utility>
+#include <vector>
 
 #include "util/callback.h"
+#include "util/mutex.h"
 
 namespace skywalker {
 
@@ -17,8 +18,14 @@ class RunLoop;
 
 class Timer;
 
+// The sequence and the node of a timer. The nodes are reused, so the
+// sequence tells whether the timer is still the one which was added.
 typedef std::pair<uint64_t, Timer*> TimerId;
 
+// A hierarchical timing wheel, which adds, removes and restarts a timer
+// in O(1) time. The first level has 256 slots of kTickMicros, and every
+// next level has 64 slots which are as long as the previous level, so the
+// timers are cascaded down to the first level when their time comes near.
 class TimerList {
  public:
   explicit TimerList(RunLoop* loop);
@@ -33,19 +40,51 @@ class TimerList {
   TimerId RunEvery(uint64_t micros_interval, const TimerProcCallback& cb);
   TimerId RunEvery(uint64_t micros_interval, TimerProcCallback&& cb);
 
+  // Runs the timer after micros_delay instead, which must be called in the
+  // loop. Returns false if the timer has run or been removed.
+  bool Restart(TimerId timer, uint64_t micros_delay);
+
   void Remove(TimerId timer);
 
   uint64_t TimeoutMicros() const;
   void RunTimerProcs();
 
  private:
-  void InsertInLoop(TimerId timer);
+  static const uint64_t kTickMicros = 64;
+  static const int kLevels = 5;
+  static const int kRootBits = 8;
+  static const int kLevelBits = 6;
+  static const size_t kRootSize = 1 << kRootBits;
+  static const size_t kLevelSize = 1 << kLevelBits;
+  static const size_t kChunkSize = 64;
+
+  TimerId Add(uint64_t micros_delay, uint64_t micros_interval,
+              TimerProcCallback&& cb);
+  bool Valid(TimerId timer) const;
+  void DeleteTimer(Timer* t);
 
-  uint64_t last_time_out_;
+  void InsertInLoop(TimerId timer);
+  void RemoveInLoop(TimerId timer);
+  void Link(Timer* t);
+  void LinkTo(Timer* t, Timer** slot, int level);
+  void Unlink(Timer* t);
+  size_t Cascade(int level);
+  uint64_t NextTick() const;
 
   RunLoop* loop_;
-  std::set<Timer*> timer_ptrs_;
-  std::set<TimerId> timers_;
+
+  // Only accessed in the loop.
+  uint64_t current_tick_;
+  Timer* root_[kRootSize];
+  Timer* levels_[kLevels - 1][kLevelSize];
+  size_t counts_[kLevels];
+  Timer* expired_;
+
+  // The timers may be added and removed in other threads.
+  mutable Mutex mutex_;
+  uint64_t sequence_;
+  std::vector<Timer*> free_timers_;
+  std::vector<Timer*> chunks_;
 
   // No copying allowed
   TimerList(const TimerList&);